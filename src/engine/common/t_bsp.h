@@ -52,6 +52,7 @@ typedef struct {
 
 // Forward of LineDefs, for Sectors.
 struct line_s;
+struct sectoredge_s;
 
 // Each sector has a degenmobj_t in its center
 //  for sound origin purposes.
@@ -120,6 +121,14 @@ typedef    struct {
     int             linecount;
     struct line_s** lines;    // [linecount] size
 
+    // neighbouring sectors, see P_GroupLines
+    int             edgecount;
+    struct sectoredge_s* edges;    // [edgecount] size
+
+    // tag index, see P_InitTagLists
+    int             firsttag;
+    int             nexttag;
+
     // [kex] stuff that happens in between tics
     fixed_t         frame_z1[2];
     fixed_t         frame_z2[2];
@@ -130,6 +139,20 @@ typedef    struct {
 
 } sector_t;
 
+//
+// A line joining a sector to the sector on its other side.
+// Kept in the same order as the sector's lines. The flags
+// mirror the line's and are refreshed by P_UpdateSectorEdges
+//
+#define SEF_TWOSIDED    1
+#define SEF_SOUNDBLOCK  2
+
+typedef struct sectoredge_s {
+    struct line_s*  line;
+    sector_t*       other;
+    int             flags;
+} sectoredge_t;
+
 
 
 
@@ -206,6 +229,10 @@ typedef struct line_s {
 
     angle_t         angle;
 
+    // tag index, see P_InitTagLists
+    int             firsttag;
+    int             nexttag;
+
 } line_t;
 
 
@@ -229,6 +229,7 @@ void CON_CvarInit(void) {
     M_RegisterCvars();
     P_RegisterCvars();
     G_RegisterCvars();
+    Z_RegisterCvars();
 
     G_AddCommand("listcvars", CMD_ListCvars, 0);
 }
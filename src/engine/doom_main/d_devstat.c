@@ -86,6 +86,9 @@ void D_DeveloperDisplay(void) {
     int p_nummobjthinkers = 0;
     fixed_t px, py, pz, pa, pp;
     int y = 8;
+    int hits, misses, evictions;
+    int used, slots, peak, pools;
+    int arenasize, framepeak;
     mobj_t* mo;
 
     if(!showstats) {
@@ -122,10 +125,26 @@ void D_DeveloperDisplay(void) {
     Draw_Text(0, y, WHITE, 0.35f, false, "Zone PU_CACHE Usage: %7d kb", Z_TagUsage(PU_CACHE) >> 10);
     y+=16;
 
+    Z_CacheStats(&hits, &misses, &evictions);
+    Draw_Text(0, y, WHITE, 0.35f, false, "Zone PU_CACHE Hits: %d Misses: %d Evictions: %d", hits, misses, evictions);
+    y+=16;
+
     Draw_Text(0, y, WHITE, 0.35f, false, "Zone PU_LEVSPEC Usage: %5d kb", Z_TagUsage(PU_LEVSPEC) >> 10);
     y+=16;
 
-    Draw_Text(0, y, WHITE, 0.35f, false, "Zone PU_AUTO Usage: %8d kb", Z_TagUsage(PU_AUTO) >> 10);
+    Z_AllocaUsage(&arenasize, &framepeak, &peak);
+    Draw_Text(0, y, WHITE, 0.35f, false, "Zone Alloca Arena: %8d kb (frame peak %d kb, peak %d kb)",
+              arenasize >> 10, framepeak >> 10, peak >> 10);
+    y+=16;
+
+    if(mobjpool) {
+        Z_PoolUsage(mobjpool, &used, &slots, &peak);
+        Draw_Text(0, y, WHITE, 0.35f, false, "Pool mobj: %d/%d slots (peak %d)", used, slots, peak);
+        y+=16;
+    }
+
+    Z_SizePoolUsage(&used, &slots, &pools);
+    Draw_Text(0, y, WHITE, 0.35f, false, "Pool thinkers: %d/%d slots in %d pools", used, slots, pools);
     y+=16;
 
     /*DRAW LIST INFORMATION*/
@@ -158,6 +177,15 @@ void D_DeveloperDisplay(void) {
 
         Draw_Text(0, y, WHITE, 0.35f, false, "P_Mobj Total Things: %i", p_nummobjthinkers);
         y+=16;
+
+        P_SightCacheStats(&hits, &misses);
+        Draw_Text(0, y, WHITE, 0.35f, false, "Sight Cache Hits: %d Misses: %d (%d%%)", hits, misses,
+                  (hits + misses) ? (int)(hits * 100.0f / (hits + misses)) : 0);
+        y+=16;
+
+        Draw_Text(0, y, WHITE, 0.35f, false, "Parked Mobjs: %i Thinkers: %i",
+                  mobjqueue.numparked, thinkerqueue.numparked);
+        y+=16;
     }
 
     /*RENDERING INFORMATION*/
@@ -55,9 +55,12 @@
 #include "st_stuff.h"
 #include "am_map.h"
 #include "p_setup.h"
+#include "p_tick.h"
 #include "d_main.h"
 #include "con_console.h"
 #include "d_devstat.h"
+#include "d_timedemo.h"
+#include "d_profile.h"
 #include "r_local.h"
 #include "r_wipe.h"
 #include "g_controls.h"
@@ -90,6 +93,8 @@ dboolean        setWindow       = true;
 int             validcount      = 1;
 dboolean        windowpause     = false;
 dboolean        devparm         = false;    // started game with -devparm
+dboolean        timingdemo      = false;    // run the demo uncapped and time it
+dboolean        nodrawers       = false;    // checkparm of -nodraw
 dboolean        nomonsters      = false;    // checkparm of -nomonsters
 dboolean        respawnparm     = false;    // checkparm of -respawn
 dboolean        respawnitem     = false;    // checkparm of -respawnitem
@@ -213,6 +218,8 @@ static void D_DrawInterface(void) {
         D_DeveloperDisplay();
     }
 
+    D_ProfDrawer();
+
 
     BusyDisk = false;
 
@@ -237,6 +244,7 @@ static void D_FinishDraw(void) {
 int D_MiniLoop(void (*start)(void), void (*stop)(void),
                void (*draw)(void), dboolean(*tick)(void)) {
     int action = gameaction = ga_nothing;
+    dboolean interpolate;
 
     if(start) {
         start();
@@ -253,6 +261,9 @@ int D_MiniLoop(void (*start)(void), void (*stop)(void),
 
         windowpause = (menuactive ? true : false);
 
+        // a timedemo draws once per tic and -nodraw never does
+        interpolate = (i_interpolateframes.value && !timingdemo && !nodrawers);
+
         // process one or more tics
 
         // get real tics
@@ -260,7 +271,7 @@ int D_MiniLoop(void (*start)(void), void (*stop)(void),
         realtics = entertic - oldentertics;
         oldentertics = entertic;
 
-        if(i_interpolateframes.value) {
+        if(interpolate) {
             renderinframe = true;
 
             if(I_StartDisplay()) {
@@ -354,7 +365,7 @@ int D_MiniLoop(void (*start)(void), void (*stop)(void),
                 I_Error("D_MiniLoop: lowtic < gametic");
             }
 
-            if(i_interpolateframes.value) {
+            if(interpolate) {
                 renderinframe = true;
 
                 if(I_StartDisplay()) {
@@ -396,10 +407,24 @@ int D_MiniLoop(void (*start)(void), void (*stop)(void),
                     I_GetTime_SaveMS();
                 }
 
+                if(timingdemo) {
+                    D_TimeDemoStartTic();
+                }
+
+                D_ProfBegin(PROF_GTICKER);
                 G_Ticker();
+                D_ProfEnd(PROF_GTICKER);
+
+                if(timingdemo) {
+                    D_TimeDemoLap(TD_GTICKER);
+                }
 
                 if(tick) {
                     action = tick();
+
+                    if(timingdemo && tick == P_Ticker) {
+                        D_TimeDemoLap(TD_PTICKER);
+                    }
                 }
 
                 if(gameaction != ga_nothing) {
@@ -430,7 +455,13 @@ int D_MiniLoop(void (*start)(void), void (*stop)(void),
 
 drawframe:
 
+        D_ProfBegin(PROF_UPDATESOUNDS);
         S_UpdateSounds();
+        D_ProfEnd(PROF_UPDATESOUNDS);
+
+        if(nodrawers) {
+            goto freealloc;
+        }
 
         // Update display, next frame, with current state.
         if(i_interpolateframes.value) {
@@ -449,6 +480,8 @@ freealloc:
 
         // force garbage collection
         Z_FreeAlloca();
+
+        D_ProfFrame();
     }
 
     gamestate = GS_NONE;
@@ -957,6 +990,14 @@ static int D_CheckDemo(void) {
         return 1;
     }
 
+    p = M_CheckParm("-timedemo");
+    if(p && p < myargc-1) {
+        timingdemo = true;
+        singledemo = true;
+        G_PlayDemo(myargv[p+1]);
+        return 1;
+    }
+
     return 0;
 }
 
@@ -966,6 +1007,7 @@ static int D_CheckDemo(void) {
 
 void D_DoomMain(void) {
     devparm = M_CheckParm("-devparm");
+    nodrawers = M_CheckParm("-nodraw");
 
     // init subsystems
 
@@ -977,6 +1019,7 @@ void D_DoomMain(void) {
 
     I_Printf("G_Init: Setting up game input and commands\n");
     G_Init();
+    D_ProfInit();
 
     I_Printf("M_LoadDefaults: Loading game configuration\n");
     M_LoadDefaults();
@@ -1011,8 +1054,10 @@ void D_DoomMain(void) {
     I_Printf("ST_Init: Init status bar.\n");
     ST_Init();
 
-    I_Printf("GL_Init: Init OpenGL\n");
-    GL_Init();
+    if(!nodrawers) {
+        I_Printf("GL_Init: Init OpenGL\n");
+        GL_Init();
+    }
 
 #ifdef USESYSCONSOLE
     I_ShowSysConsole(false);
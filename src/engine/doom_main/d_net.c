@@ -38,6 +38,7 @@
 #include "con_console.h"
 #include "SDL.h"
 #include "i_video.h"
+#include "d_profile.h"
 
 #define FEATURE_MULTIPLAYER 1
 
@@ -115,6 +116,8 @@ void NetUpdate(void) {
         return;
     }
 
+    D_ProfBegin(PROF_NETUPDATE);
+
 #ifdef FEATURE_MULTIPLAYER
 
     // Run network subsystems
@@ -125,17 +128,23 @@ void NetUpdate(void) {
 #endif
 
     // check time
-    nowtime = GetAdjustedTime()/ticdup;
-    newtics = nowtime - gametime;
-    gametime = nowtime;
-
-    if(skiptics <= newtics) {
-        newtics -= skiptics;
-        skiptics = 0;
+    if(timingdemo) {
+        // no clock, just keep one tic ahead of the game
+        newtics = (maketic <= gametic/ticdup);
     }
     else {
-        skiptics -= newtics;
-        newtics = 0;
+        nowtime = GetAdjustedTime()/ticdup;
+        newtics = nowtime - gametime;
+        gametime = nowtime;
+
+        if(skiptics <= newtics) {
+            newtics -= skiptics;
+            skiptics = 0;
+        }
+        else {
+            skiptics -= newtics;
+            newtics = 0;
+        }
     }
 
     // build new ticcmds for console player(s)
@@ -187,6 +196,8 @@ void NetUpdate(void) {
         ++maketic;
         nettics[consoleplayer] = maketic;
     }
+
+    D_ProfEnd(PROF_NETUPDATE);
 }
 
 //
@@ -0,0 +1,369 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// Copyright(C) 2007-2012 Samuel Villarreal
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+//-----------------------------------------------------------------------------
+//
+// DESCRIPTION:
+//    Scoped timers for the main loop. While profiling is on, each
+//    scope adds up its time every frame. The last PROF_HISTORY frames
+//    are kept so the on-screen breakdown can show averages, peaks and
+//    a histogram. The profiletrace command records every scope for a
+//    number of frames and writes them out as Chrome trace events, for
+//    chrome://tracing or Perfetto.
+//
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+
+#include "SDL.h"
+
+#include "doomdef.h"
+#include "doomstat.h"
+#include "i_system.h"
+#include "con_console.h"
+#include "g_actions.h"
+#include "gl_draw.h"
+#include "d_profile.h"
+
+#define PROF_HISTORY        128
+#define PROF_MAXDEPTH       32
+#define PROF_NUMBUCKETS     8
+#define PROF_TRACEFRAMES    300
+
+typedef struct {
+    const char  *name;
+    uint64      frametime;          // time spent this frame
+    int         framecalls;
+    int         depth;              // nesting depth when last entered
+    float       history[PROF_HISTORY];
+    int         calls;              // calls in the last finished frame
+} profstat_t;
+
+typedef struct {
+    profscope_t scope;
+    uint64      start;
+} profframe_t;
+
+typedef struct {
+    profscope_t scope;
+    uint64      start;
+    uint64      end;
+} profevent_t;
+
+static profstat_t profstats[NUMPROFSCOPES] = {
+    { "G_Ticker" },
+    { "P_Ticker" },
+    { "P_RunThinkers" },
+    { "P_ScanSights" },
+    { "P_RunMobjs" },
+    { "P_UpdateSpecials" },
+    { "R_RenderPlayerView" },
+    { "DL_ProcessDrawList" },
+    { "S_UpdateSounds" },
+    { "NetUpdate" }
+};
+
+// upper bounds of the histogram buckets, in milliseconds
+static const float profbuckets[PROF_NUMBUCKETS - 1] = {
+    0.05f, 0.1f, 0.25f, 0.5f, 1.0f, 2.0f, 4.0f
+};
+
+static dboolean     profactive = false;
+static profframe_t  profstack[PROF_MAXDEPTH];
+static int          profdepth = 0;
+static int          profframe = 0;
+static int          profframes = 0;
+static double       proftomsec = 0;
+
+static profevent_t* profevents = NULL;
+static int          numprofevents = 0;
+static int          maxprofevents = 0;
+static int          proftraceframes = 0;
+static uint64       proftracestart = 0;
+static char*        proftracepath = NULL;
+
+//
+// D_ProfBegin
+//
+
+void D_ProfBegin(profscope_t scope) {
+    if(!profactive) {
+        return;
+    }
+
+    if(profdepth == PROF_MAXDEPTH) {
+        I_Error("D_ProfBegin: %s nested too deep", profstats[scope].name);
+    }
+
+    profstats[scope].depth = profdepth;
+
+    profstack[profdepth].scope = scope;
+    profstack[profdepth].start = SDL_GetPerformanceCounter();
+    profdepth++;
+}
+
+//
+// D_ProfEnd
+//
+
+void D_ProfEnd(profscope_t scope) {
+    profstat_t *stat;
+    profevent_t *ev;
+    uint64 now;
+
+    // profiling may have been turned on inside the scope
+    if(!profactive || profdepth == 0 || profstack[profdepth - 1].scope != scope) {
+        return;
+    }
+
+    now = SDL_GetPerformanceCounter();
+
+    profdepth--;
+
+    stat = &profstats[scope];
+    stat->frametime += now - profstack[profdepth].start;
+    stat->framecalls++;
+
+    // scopes already open when the trace started are left out
+    if(proftraceframes > 0 && profstack[profdepth].start >= proftracestart) {
+        if(numprofevents == maxprofevents) {
+            maxprofevents = maxprofevents ? maxprofevents * 2 : 4096;
+            profevents = realloc(profevents, maxprofevents * sizeof(profevent_t));
+
+            if(profevents == NULL) {
+                I_Error("D_ProfEnd: Couldn't realloc trace events");
+            }
+        }
+
+        ev = &profevents[numprofevents++];
+        ev->scope = scope;
+        ev->start = profstack[profdepth].start;
+        ev->end = now;
+    }
+}
+
+//
+// D_ProfWriteTrace
+//
+
+static void D_ProfWriteTrace(void) {
+    double tousec;
+    FILE *f;
+    int i;
+
+    if(!(f = fopen(proftracepath, "w"))) {
+        CON_Warnf("Couldn't write %s\n", proftracepath);
+        return;
+    }
+
+    tousec = proftomsec * 1000.0;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+            "\"args\":{\"name\":\"main\"}}");
+
+    for(i = 0; i < numprofevents; i++) {
+        profevent_t *ev = &profevents[i];
+
+        fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"engine\",\"ph\":\"X\","
+                "\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+                profstats[ev->scope].name,
+                (double)(ev->start - proftracestart) * tousec,
+                (double)(ev->end - ev->start) * tousec);
+    }
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+
+    CON_Printf(WHITE, "Wrote %d trace events to %s\n", numprofevents, proftracepath);
+}
+
+//
+// D_ProfFrame
+// Called once per main loop iteration
+//
+
+void D_ProfFrame(void) {
+    profstat_t *stat;
+    int i;
+
+    if(!profactive) {
+        return;
+    }
+
+    for(i = 0; i < NUMPROFSCOPES; i++) {
+        stat = &profstats[i];
+
+        stat->history[profframe] = (float)((double)stat->frametime * proftomsec);
+        stat->calls = stat->framecalls;
+        stat->frametime = 0;
+        stat->framecalls = 0;
+    }
+
+    profframe = (profframe + 1) % PROF_HISTORY;
+
+    if(profframes < PROF_HISTORY) {
+        profframes++;
+    }
+
+    if(proftraceframes > 0 && --proftraceframes == 0) {
+        D_ProfWriteTrace();
+
+        free(proftracepath);
+        proftracepath = NULL;
+        numprofevents = 0;
+    }
+}
+
+//
+// D_ProfDrawer
+//
+
+void D_ProfDrawer(void) {
+    char hist[PROF_NUMBUCKETS + 1];
+    int counts[PROF_NUMBUCKETS];
+    profstat_t *stat;
+    float total;
+    float peak;
+    int x = 440;
+    int y = 8;
+    int i;
+    int j;
+    int b;
+
+    if(!profactive || profframes == 0) {
+        return;
+    }
+
+    Draw_Text(x, y, YELLOW, 0.35f, false, "Scope avg/peak ms, calls, hist (%d frames)", profframes);
+    y += 16;
+
+    for(i = 0; i < NUMPROFSCOPES; i++) {
+        stat = &profstats[i];
+
+        total = peak = 0;
+        dmemset(counts, 0, sizeof(counts));
+
+        for(j = 0; j < profframes; j++) {
+            float t = stat->history[j];
+
+            total += t;
+
+            if(t > peak) {
+                peak = t;
+            }
+
+            for(b = 0; b < PROF_NUMBUCKETS - 1 && t > profbuckets[b]; b++);
+            counts[b]++;
+        }
+
+        if(peak == 0) {
+            continue;
+        }
+
+        // each bucket as a share of the window from 0 to 9
+        for(b = 0; b < PROF_NUMBUCKETS; b++) {
+            hist[b] = '0' + (counts[b] * 9 + profframes - 1) / profframes;
+        }
+
+        hist[PROF_NUMBUCKETS] = 0;
+
+        Draw_Text(x + stat->depth * 12, y, WHITE, 0.35f, false, "%s %.2f/%.2f x%d %s",
+                  stat->name, total / profframes, peak, stat->calls, hist);
+        y += 16;
+    }
+}
+
+//
+// D_ProfReset
+//
+
+static void D_ProfReset(void) {
+    int i;
+
+    for(i = 0; i < NUMPROFSCOPES; i++) {
+        profstats[i].frametime = 0;
+        profstats[i].framecalls = 0;
+        profstats[i].calls = 0;
+        profstats[i].depth = 0;
+        dmemset(profstats[i].history, 0, sizeof(profstats[i].history));
+    }
+
+    profdepth = 0;
+    profframe = 0;
+    profframes = 0;
+    proftomsec = 1000.0 / (double)SDL_GetPerformanceFrequency();
+}
+
+//
+// CMD_Profile
+//
+
+static CMD(Profile) {
+    if(!profactive) {
+        D_ProfReset();
+    }
+
+    profactive ^= 1;
+    proftraceframes = 0;
+}
+
+//
+// CMD_ProfileTrace
+// profiletrace [frames] [file]
+//
+
+static CMD(ProfileTrace) {
+    int frames = PROF_TRACEFRAMES;
+
+    if(param[0]) {
+        frames = datoi(param[0]);
+    }
+
+    if(frames <= 0) {
+        return;
+    }
+
+    if(!profactive) {
+        D_ProfReset();
+        profactive = true;
+    }
+
+    free(proftracepath);
+
+    if(!(proftracepath = I_GetUserFile(param[0] && param[1] ? param[1] : "trace.json"))) {
+        return;
+    }
+
+    numprofevents = 0;
+    proftraceframes = frames;
+    proftracestart = SDL_GetPerformanceCounter();
+
+    CON_Printf(WHITE, "Tracing the next %d frames\n", frames);
+}
+
+//
+// D_ProfInit
+//
+
+void D_ProfInit(void) {
+    G_AddCommand("profile", CMD_Profile, 0);
+    G_AddCommand("profiletrace", CMD_ProfileTrace, 0);
+}
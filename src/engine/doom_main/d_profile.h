@@ -0,0 +1,48 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// Copyright(C) 2007-2012 Samuel Villarreal
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __D_PROFILE_H
+#define __D_PROFILE_H
+
+// Timed scopes. Scopes nest; each D_ProfBegin must be matched
+// by a D_ProfEnd of the same scope on the main thread.
+typedef enum {
+    PROF_GTICKER,
+    PROF_PTICKER,
+    PROF_RUNTHINKERS,
+    PROF_SCANSIGHTS,
+    PROF_RUNMOBJS,
+    PROF_UPDATESPECIALS,
+    PROF_RENDERVIEW,
+    PROF_DRAWLIST,
+    PROF_UPDATESOUNDS,
+    PROF_NETUPDATE,
+    NUMPROFSCOPES
+} profscope_t;
+
+void D_ProfBegin(profscope_t scope);
+void D_ProfEnd(profscope_t scope);
+void D_ProfFrame(void);
+void D_ProfDrawer(void);
+void D_ProfInit(void);
+
+#endif
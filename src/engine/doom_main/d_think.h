@@ -56,11 +56,28 @@ typedef union {
 typedef actionf_t  think_t;
 
 
+// Links used by the tic scheduler (p_sched.c). A node is either
+//  on the run list, waiting to be merged back into it, or parked.
+typedef struct schednode_s {
+    struct schednode_s* prev;
+    struct schednode_s* next;
+    int                 seq;        // link order, matches the owning list
+    int                 where;
+    int                 parked;     // pass the node was parked on
+    int                 wake;       // pass after which it is due
+    int                 count;      // counter value when parked
+    int*                counter;    // NULL if parked until woken
+    void*               check;      // state/function when parked
+
+} schednode_t;
+
+
 // Doubly linked list of actors.
 typedef struct thinker_s {
     struct thinker_s*   prev;
     struct thinker_s*   next;
     think_t             function;
+    schednode_t         sched;
 
 } thinker_t;
 
@@ -0,0 +1,150 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// Copyright(C) 2007-2012 Samuel Villarreal
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+//-----------------------------------------------------------------------------
+//
+// DESCRIPTION:
+//    -timedemo benchmarking. The demo is played back as fast as the
+//    game can tick, and the time spent in G_Ticker and P_Ticker is
+//    sampled every tic so a report can be printed once it ends.
+//
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+
+#include "SDL.h"
+
+#include "doomdef.h"
+#include "doomstat.h"
+#include "i_system.h"
+#include "d_timedemo.h"
+
+typedef struct {
+    float*  samples;    // milliseconds per tic
+    int     count;
+    int     max;
+} tdsamples_t;
+
+static const char *tdstatnames[NUMTDSTATS] = {
+    "G_Ticker",
+    "P_Ticker"
+};
+
+static tdsamples_t  tdstats[NUMTDSTATS];
+static uint64       tdstarttime;
+static uint64       tdlaptime;
+static int          tdstarttic;
+
+//
+// D_TimeDemoStart
+//
+
+void D_TimeDemoStart(void) {
+    int i;
+
+    for(i = 0; i < NUMTDSTATS; i++) {
+        tdstats[i].count = 0;
+    }
+
+    tdstarttic = gametic;
+    tdstarttime = SDL_GetPerformanceCounter();
+}
+
+//
+// D_TimeDemoStartTic
+//
+
+void D_TimeDemoStartTic(void) {
+    tdlaptime = SDL_GetPerformanceCounter();
+}
+
+//
+// D_TimeDemoLap
+// Charges the time since the last lap to stat
+//
+
+void D_TimeDemoLap(tdstat_t stat) {
+    tdsamples_t *s = &tdstats[stat];
+    uint64 now;
+
+    now = SDL_GetPerformanceCounter();
+
+    if(s->count == s->max) {
+        s->max = s->max ? s->max * 2 : 4096;
+        s->samples = realloc(s->samples, s->max * sizeof(float));
+
+        if(s->samples == NULL) {
+            I_Error("D_TimeDemoLap: Couldn't realloc samples");
+        }
+    }
+
+    s->samples[s->count++] = (float)((double)(now - tdlaptime) * 1000.0 /
+                                     (double)SDL_GetPerformanceFrequency());
+    tdlaptime = now;
+}
+
+//
+// D_CompareSamples
+//
+
+static int D_CompareSamples(const void *a, const void *b) {
+    float fa = *(const float*)a;
+    float fb = *(const float*)b;
+
+    return (fa > fb) - (fa < fb);
+}
+
+//
+// D_TimeDemoReport
+//
+
+void D_TimeDemoReport(void) {
+    double seconds;
+    double total;
+    int tics;
+    int i;
+    int j;
+
+    seconds = (double)(SDL_GetPerformanceCounter() - tdstarttime) /
+              (double)SDL_GetPerformanceFrequency();
+    tics = gametic - tdstarttic;
+
+    I_Printf("timedemo: %d tics in %.3f seconds, %.1f tics/sec\n",
+             tics, seconds, seconds > 0 ? tics / seconds : 0.0);
+
+    for(i = 0; i < NUMTDSTATS; i++) {
+        tdsamples_t *s = &tdstats[i];
+
+        if(s->count == 0) {
+            continue;
+        }
+
+        qsort(s->samples, s->count, sizeof(float), D_CompareSamples);
+
+        total = 0;
+        for(j = 0; j < s->count; j++) {
+            total += s->samples[j];
+        }
+
+        I_Printf("timedemo: %-8s min %.4f ms, avg %.4f ms, p99 %.4f ms, max %.4f ms (%d tics)\n",
+                 tdstatnames[i], s->samples[0], total / s->count,
+                 s->samples[(s->count * 99) / 100], s->samples[s->count - 1], s->count);
+    }
+}
@@ -34,6 +34,7 @@
 #include "m_misc.h"
 #include "m_random.h"
 #include "con_console.h"
+#include "d_timedemo.h"
 
 #ifdef _MSVC_VER
 #include "i_opndir.h"
@@ -224,6 +225,10 @@ void G_PlayDemo(const char* name) {
     endDemo = false;
 
     p = M_CheckParm("-playdemo");
+    if(!p) {
+        p = M_CheckParm("-timedemo");
+    }
+
     if(p && p < myargc-1) {
         // 20120107 bkw: add .lmp extension if missing.
         if(dstrrchr(myargv[p+1], '.')) {
@@ -312,6 +317,10 @@ void G_PlayDemo(const char* name) {
     usergame = false;
     demoplayback = true;
 
+    if(timingdemo) {
+        D_TimeDemoStart();
+    }
+
     G_RunGame();
     iwadDemo = false;
 }
@@ -333,6 +342,10 @@ dboolean G_CheckDemoStatus(void) {
     }
 
     if(demoplayback) {
+        if(timingdemo) {
+            D_TimeDemoReport();
+        }
+
         if(singledemo) {
             I_Quit();
         }
@@ -46,6 +46,7 @@
 #include "st_stuff.h"
 #include "am_map.h"
 #include "w_wad.h"
+#include "w_prefetch.h"
 #include "p_local.h"
 #include "s_sound.h"
 #include "d_englsh.h"
@@ -150,6 +151,17 @@ NETCVAR_PARAM(compat_mobjpass,  1,  compatflags,    COMPATF_MOBJPASS);
 NETCVAR_PARAM(compat_limitpain, 1,  compatflags,    COMPATF_LIMITPAIN);
 NETCVAR_PARAM(compat_grabitems, 1,  compatflags,    COMPATF_REACHITEMS);
 
+// the flag is the inverse of the cvar so that it stays clear,
+// keeping the 128 cap, in old demos and for old peers
+NETCVAR_CMD(compat_intercepts, 1) {
+    if(cvar->value > 0) {
+        compatflags &= ~COMPATF_UNLIMITEDINTERCEPTS;
+    }
+    else {
+        compatflags |= COMPATF_UNLIMITEDINTERCEPTS;
+    }
+}
+
 CVAR_EXTERNAL(v_mlook);
 CVAR_EXTERNAL(v_mlookinvert);
 CVAR_EXTERNAL(v_yaxismove);
@@ -179,6 +191,7 @@ void G_RegisterCvars(void) {
     CON_CvarRegister(&compat_mobjpass);
     CON_CvarRegister(&compat_limitpain);
     CON_CvarRegister(&compat_grabitems);
+    CON_CvarRegister(&compat_intercepts);
 }
 
 //
@@ -560,6 +573,45 @@ static CMD(EndDemo) {
     endDemo = true;
 }
 
+//
+// G_CmdZoneProfile
+// With no arguments toggles the zone allocation profiler, writing the
+// report when it stops. "dump" writes it without stopping. Either can
+// be followed by a file name to use instead of zoneprofile.txt.
+//
+
+static CMD(ZoneProfile) {
+    char *name;
+    char *path;
+    int sites;
+
+    if(param[0] && !dstricmp(param[0], "dump")) {
+        name = param[1];
+    }
+    else if(!Z_ProfileActive()) {
+        Z_ProfileStart();
+        CON_Printf(WHITE, "Zone profiling started\n");
+        return;
+    }
+    else {
+        Z_ProfileStop();
+        name = param[0];
+    }
+
+    if(!(path = I_GetUserFile(name ? name : "zoneprofile.txt"))) {
+        return;
+    }
+
+    if((sites = Z_ProfileDump(path)) < 0) {
+        CON_Warnf("Couldn't write %s\n", path);
+    }
+    else {
+        CON_Printf(WHITE, "Wrote %d allocation sites to %s\n", sites, path);
+    }
+
+    free(path);
+}
+
 //
 // G_SaveDefaults
 //
@@ -879,6 +931,7 @@ static void G_SetGameFlags(void) {
     if(compat_mobjpass.value > 0)  compatflags |= COMPATF_MOBJPASS;
     if(compat_limitpain.value > 0) compatflags |= COMPATF_LIMITPAIN;
     if(compat_grabitems.value > 0) compatflags |= COMPATF_REACHITEMS;
+    if(compat_intercepts.value <= 0) compatflags |= COMPATF_UNLIMITEDINTERCEPTS;
 }
 
 //
@@ -899,6 +952,12 @@ void G_DoLoadLevel(void) {
 
     basetic = gametic;
 
+    // snapshots from another map, game, or the title map can't
+    // be rewound to; loading a save or a snapshot sorts itself out
+    if(gameaction != ga_loadgame) {
+        P_ClearSnapshots();
+    }
+
     // update settings from server cvar
     if(!netgame) {
         gameskill   = (int)sv_skill.value;
@@ -1030,6 +1089,7 @@ void G_Ticker(void) {
     int         i;
     int         buf;
     ticcmd_t*   cmd;
+    dboolean    saved;
 
     G_ActionTicker();
     CON_Ticker();
@@ -1039,6 +1099,12 @@ void G_Ticker(void) {
         savenow = false;
     }
 
+    // saves are written in the background, so
+    // only say so once the file is really there
+    if(P_PollSaveGame(&saved)) {
+        players[consoleplayer].message = saved ? GGSAVED : "couldn't save game!";
+    }
+
     if(gameaction == ga_screenshot) {
         M_ScreenShot();
         gameaction = ga_nothing;
@@ -1404,6 +1470,8 @@ void G_ExitLevel(void) {
     P_SpawnDelayTimer(&junk, G_CompleteLevel);
 
     nextmap = gamemap + 1;
+
+    W_PrefetchMap(nextmap);
 }
 
 //
@@ -1422,6 +1490,8 @@ void G_SecretExitLevel(int map) {
     P_SpawnDelayTimer(&junk, G_CompleteLevel);
 
     nextmap = map;
+
+    W_PrefetchMap(nextmap);
 }
 
 //
@@ -1526,6 +1596,18 @@ void G_LoadGame(const char* name) {
 void G_DoLoadGame(void) {
     CON_DPrintf("--------Loading game--------\n");
 
+    // the rewind command loads from memory instead
+    if(P_SnapshotPending()) {
+        if(!P_RestoreSnapshot()) {
+            gameaction = ga_nothing;
+            players[consoleplayer].message = "couldn't rewind!";
+        }
+
+        return;
+    }
+
+    P_ClearSnapshots();
+
     if(!P_ReadSaveGame(savename)) {
         gameaction = ga_nothing;
         players[consoleplayer].message = "couldn't load game!";
@@ -1559,7 +1641,6 @@ void G_DoSaveGame(void) {
     }
 
     savedescription[0] = 0;
-    players[consoleplayer].message = GGSAVED;
 }
 
 
@@ -1636,6 +1717,7 @@ void G_Init(void) {
     G_AddCommand("setcamerastatic", CMD_PlayerCamera, 0);
     G_AddCommand("setcamerachase", CMD_PlayerCamera, 1);
     G_AddCommand("enddemo", CMD_EndDemo, 0);
+    G_AddCommand("zoneprofile", CMD_ZoneProfile, 0);
 }
 
 //
@@ -41,6 +41,7 @@
 #include "st_stuff.h"
 #include "r_wipe.h"
 #include "gl_draw.h"
+#include "w_prefetch.h"
 
 #define WIALPHARED      D_RGBA(0xC0, 0, 0, 0xFF)
 
@@ -115,6 +116,9 @@ void WI_Start(void) {
     // start music
     S_StartMusic(mus_complete);
 
+    // start reading the next map while the stats tally up
+    W_PrefetchMap(nextmap);
+
     allowmenu = true;
 }
 
@@ -1144,6 +1144,7 @@ CVAR_EXTERNAL(compat_collision);
 CVAR_EXTERNAL(compat_limitpain);
 CVAR_EXTERNAL(compat_mobjpass);
 CVAR_EXTERNAL(compat_grabitems);
+CVAR_EXTERNAL(compat_intercepts);
 CVAR_EXTERNAL(r_wipe);
 CVAR_EXTERNAL(r_rendersprites);
 CVAR_EXTERNAL(r_texturecombiner);
@@ -1178,6 +1179,7 @@ enum {
     misc_comp_pain,
     misc_comp_pass,
     misc_comp_grab,
+    misc_comp_intercepts,
     misc_default,
     misc_return,
     misc_end
@@ -1212,6 +1214,7 @@ menuitem_t MiscMenu[]= {
     {2,"Limit Lost Souls:",M_MiscChoice,'l'},
     {2,"Tall Actors:",M_MiscChoice,'i'},
     {2,"Grab High Items:",M_MiscChoice,'g'},
+    {2,"Limit Intercepts:",M_MiscChoice,'n'},
     {-2,"Default",M_DoDefaults,'d'},
     {1,"/r Return",M_Return, 0x20}
 };
@@ -1245,6 +1248,7 @@ char* MiscHints[misc_end]= {
     "limit max amount of lost souls spawned by pain elemental to 17",
     "emulate infinite height bug for all solid actors",
     "be able to grab high items by bumping into the sector it sits on",
+    "long traces ignore anything past the first 128 lines and things crossed",
     NULL,
     NULL
 };
@@ -1271,6 +1275,7 @@ menudefault_t MiscDefault[] = {
     { &compat_limitpain, 1 },
     { &compat_mobjpass, 1 },
     { &compat_grabitems, 1 },
+    { &compat_intercepts, 1 },
     { NULL, -1 }
 };
 
@@ -1417,6 +1422,10 @@ void M_MiscChoice(int choice) {
     case misc_comp_grab:
         M_SetOptionValue(choice, 0, 1, 1, &compat_grabitems);
         break;
+
+    case misc_comp_intercepts:
+        M_SetOptionValue(choice, 0, 1, 1, &compat_intercepts);
+        break;
     }
 }
 
@@ -1468,6 +1477,7 @@ void M_DrawMisc(void) {
     DRAWMISCITEM(misc_comp_pain, compat_limitpain.value, msgNames);
     DRAWMISCITEM(misc_comp_pass, !compat_mobjpass.value, msgNames);
     DRAWMISCITEM(misc_comp_grab, compat_grabitems.value, msgNames);
+    DRAWMISCITEM(misc_comp_intercepts, compat_intercepts.value, msgNames);
 
 #undef DRAWMISCITEM
 
@@ -41,6 +41,7 @@
 #include "net_structrw.h"
 
 #include "st_stuff.h"
+#include "w_checksum.h"
 #include "w_wad.h"
 
 CVAR_EXTERNAL(sv_nomonsters);
@@ -178,8 +179,6 @@ static fixed_t average_latency;
 
 #define NET_CL_ExpandTicNum(b) NET_ExpandTicNum(recvwindow_start, (b))
 
-void W_Checksum(md5_digest_t digest);
-
 // Called when a player leaves the game
 
 static void NET_CL_PlayerQuitGame(player_t *player)
@@ -30,6 +30,7 @@
 #include "i_png.h"
 #include "i_system.h"
 #include "w_wad.h"
+#include "w_meta.h"
 #include "z_zone.h"
 #include "gl_texture.h"
 #include "gl_main.h"
@@ -122,6 +123,48 @@ static CMD(ResetTextures) {
     GL_ResetTextures();
 }
 
+//
+// GetTextureInfo
+// Gets the dimensions and offsets of a PNG lump, preferring the
+// lump metadata cache, then a header scan and finally a full decode
+//
+
+static void GetTextureInfo(int lump, int *w, int *h, int *offset) {
+    lumpmeta_t meta;
+    dboolean valid;
+
+    dmemset(&meta, 0, sizeof(lumpmeta_t));
+
+    if(!W_GetLumpMeta(lump, &meta)) {
+        valid = I_PNGReadHeader(lump, &meta.width, &meta.height, meta.offset);
+
+        if(!valid) {
+            Pixmap *pixmap;
+
+            pixmap = I_PNGReadData(lump, true, true, false,
+                                   &meta.width, &meta.height, meta.offset, 0);
+
+            if(pixmap) {
+                valid = true;
+                Pixmap_Free(pixmap);
+            }
+        }
+
+        // don't remember a lump that couldn't be read
+        if(valid) {
+            W_SetLumpMeta(lump, &meta);
+        }
+    }
+
+    *w = meta.width;
+    *h = meta.height;
+
+    if(offset) {
+        offset[0] = meta.offset[0];
+        offset[1] = meta.offset[1];
+    }
+}
+
 //
 // InitWorldTextures
 //
@@ -140,7 +183,6 @@ static void InitWorldTextures(void) {
     textureheight       = Z_Calloc(numtextures * sizeof(word), PU_STATIC, NULL);
 
     for(i = 0; i < numtextures; i++) {
-        Pixmap *pixmap;
         int w;
         int h;
 
@@ -155,14 +197,12 @@ static void InitWorldTextures(void) {
         texturetranslation[i] = i;
         palettetranslation[i] = 0;
 
-        // read PNG and setup global width and heights
-        pixmap = I_PNGReadData(t_start + i, true, true, false, &w, &h, NULL, 0);
+        // setup global width and heights
+        GetTextureInfo(t_start + i, &w, &h, NULL);
 
         textureptr[i][0] = 0;
         texturewidth[i] = w;
         textureheight[i] = h;
-
-        Pixmap_Free(pixmap);
     }
 
     CON_DPrintf("%i world textures initialized\n", numtextures);
@@ -330,19 +370,16 @@ static void InitGfxTextures(void) {
     gfxorigheight   = Z_Calloc(numgfx * sizeof(short), PU_STATIC, NULL);
 
     for(i = 0; i < numgfx; i++) {
-        Pixmap *pixmap;
         int w;
         int h;
 
-        pixmap = I_PNGReadData(g_start + i, true, true, false, &w, &h, NULL, 0);
+        GetTextureInfo(g_start + i, &w, &h, NULL);
 
         gfxptr[i] = 0;
         gfxwidth[i] = w;
         gfxorigwidth[i] = w;
         gfxorigheight[i] = h;
         gfxheight[i] = h;
-
-        Pixmap_Free(pixmap);
     }
 
     CON_DPrintf("%i generic textures initialized\n", numgfx);
@@ -459,7 +496,6 @@ static void InitSpriteTextures(void) {
     CON_DPrintf("%i external palettes initialized\n", palcnt);
 
     for(i = 0; i < numsprtex; i++) {
-        Pixmap *pixmap;
         int w;
         int h;
         size_t x;
@@ -472,15 +508,13 @@ static void InitSpriteTextures(void) {
             spriteptr[i][x] = 0;
         }
 
-        // read data and setup globals
-        pixmap = I_PNGReadData(s_start + i, true, true, false, &w, &h, offset, 0);
+        // setup globals
+        GetTextureInfo(s_start + i, &w, &h, offset);
 
         spritewidth[i]      = w;
         spriteheight[i]     = h;
         spriteoffset[i]     = (float)offset[0];
         spritetopoffset[i]  = (float)offset[1];
-
-        Pixmap_Free(pixmap);
     }
 }
 
@@ -905,6 +939,8 @@ void GL_InitTextures(void) {
     InitGfxTextures();
     InitSpriteTextures();
 
+    W_SaveLumpMeta();
+
     G_AddCommand("dumptextures", CMD_DumpTextures, 0);
     G_AddCommand("resettextures", CMD_ResetTextures, 0);
 }
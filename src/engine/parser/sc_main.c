@@ -40,6 +40,8 @@
 
 scparser_t sc_parser;
 
+static int sc_lump = -1;
+
 //
 // SC_Open
 //
@@ -63,6 +65,8 @@ static void SC_Open(char* name) {
         sc_parser.buffsize   = W_LumpLength(lump);
     }
 
+    sc_lump = lump;
+
     CON_DPrintf("%s size: %ikb\n", name, sc_parser.buffsize >> 10);
 
     sc_parser.pointer_start  = sc_parser.buffer;
@@ -77,7 +81,14 @@ static void SC_Open(char* name) {
 //
 
 static void SC_Close(void) {
-    Z_Free(sc_parser.buffer);
+    if(sc_lump <= -1) {
+        Z_Free(sc_parser.buffer);
+    }
+    else {
+        W_ReleaseLumpNum(sc_lump);
+    }
+
+    sc_lump = -1;
 
     sc_parser.buffer         = NULL;
     sc_parser.buffsize       = 0;
@@ -0,0 +1,379 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// Copyright(C) 2007-2012 Samuel Villarreal
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+//-----------------------------------------------------------------------------
+//
+// DESCRIPTION:
+//    Blockmap generation, for maps that ship without one or whose
+//    blockmap is too big for 16 bit offsets.
+//
+//    Lines are first sorted into the rows of blocks their bounding box
+//    spans. Rows are then shared out between worker threads, which test
+//    each line against the blocks it could touch. Block edges are widened
+//    by a unit so lines lying along an edge go into both blocks. Lists
+//    keep lines in index order and all empty blocks share a single list.
+//
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+
+#include "SDL.h"
+
+#include "doomdef.h"
+#include "doomstat.h"
+#include "m_fixed.h"
+#include "m_misc.h"
+#include "i_system.h"
+#include "p_local.h"
+#include "z_zone.h"
+
+#define BLOCKMAP_MAXTHREADS 8
+
+typedef struct {
+    int*        data;       // lists for the row, each ending in -1
+    int*        start;      // where each block's list starts in data
+    int         count;
+} bmaprow_t;
+
+static bmaprow_t*   bmaprows;
+static int*         rowlines;       // candidate lines, grouped by row
+static int*         rowfirst;       // first candidate of each row, plus one past the end
+static int          nextbmaprow;
+static SDL_mutex*   bmaplock = NULL;
+
+//
+// P_BlockRange
+// Blocks covered by a span of map coordinates, widened by a unit
+// and clipped to the blockmap. The span can be further from the
+// origin than fixed point reaches, so the sums are done in 64 bits
+//
+
+static void P_BlockRange(fixed_t lo, fixed_t hi, fixed_t org, int size, int *first, int *last) {
+    *first = (int)(((int64)lo - FRACUNIT - org) >> MAPBLOCKSHIFT);
+    *last = (int)(((int64)hi + FRACUNIT - org) >> MAPBLOCKSHIFT);
+
+    if(*first < 0) {
+        *first = 0;
+    }
+
+    if(*last >= size) {
+        *last = size - 1;
+    }
+}
+
+//
+// P_BlockEdge
+// Map coordinate of the n'th block edge from the origin, moved out
+// by a unit. Edges past the range of fixed point are clamped, which
+// doesn't change which lines cross the block
+//
+
+static fixed_t P_BlockEdge(fixed_t org, int n, int widen) {
+    int64 edge = (int64)org + ((int64)n << MAPBLOCKSHIFT) + widen;
+
+    if(edge > D_MAXINT) {
+        return D_MAXINT;
+    }
+
+    if(edge < D_MININT) {
+        return D_MININT;
+    }
+
+    return (fixed_t)edge;
+}
+
+//
+// P_BlockMapRow
+//
+
+static void P_BlockMapRow(int y, int *pairs, int *counts) {
+    bmaprow_t *row = &bmaprows[y];
+    fixed_t box[4];
+    int numpairs;
+    int total;
+    int x;
+    int xl;
+    int xh;
+    int i;
+
+    box[BOXBOTTOM] = P_BlockEdge(bmaporgy, y, -FRACUNIT);
+    box[BOXTOP] = P_BlockEdge(bmaporgy, y + 1, FRACUNIT);
+
+    dmemset(counts, 0, bmapwidth * sizeof(int));
+    numpairs = 0;
+
+    // candidates come in index order, so a
+    // stable sort by block keeps them that way
+    for(i = rowfirst[y]; i < rowfirst[y + 1]; i++) {
+        line_t *ld = &lines[rowlines[i]];
+
+        P_BlockRange(ld->bbox[BOXLEFT], ld->bbox[BOXRIGHT], bmaporgx, bmapwidth, &xl, &xh);
+
+        for(x = xl; x <= xh; x++) {
+            box[BOXLEFT] = P_BlockEdge(bmaporgx, x, -FRACUNIT);
+            box[BOXRIGHT] = P_BlockEdge(bmaporgx, x + 1, FRACUNIT);
+
+            if(P_BoxOnLineSide(box, ld) != -1) {
+                continue;
+            }
+
+            pairs[numpairs * 2 + 0] = x;
+            pairs[numpairs * 2 + 1] = rowlines[i];
+            numpairs++;
+            counts[x]++;
+        }
+    }
+
+    row->start = malloc(bmapwidth * sizeof(int));
+    total = 0;
+
+    for(x = 0; x < bmapwidth; x++) {
+        if(!counts[x]) {
+            row->start[x] = -1;     // uses the shared empty list
+            continue;
+        }
+
+        row->start[x] = total;
+        total += counts[x] + 1;
+    }
+
+    row->count = total;
+    row->data = malloc(MAX(total, 1) * sizeof(int));
+
+    for(x = 0; x < bmapwidth; x++) {
+        if(row->start[x] != -1) {
+            counts[x] = row->start[x];
+        }
+    }
+
+    for(i = 0; i < numpairs; i++) {
+        row->data[counts[pairs[i * 2]]++] = pairs[i * 2 + 1];
+    }
+
+    for(x = 0; x < bmapwidth; x++) {
+        if(row->start[x] != -1) {
+            row->data[counts[x]] = -1;
+        }
+    }
+}
+
+//
+// P_BlockMapThread
+//
+
+static int SDLCALL P_BlockMapThread(void *data) {
+    int *pairs;
+    int *counts;
+    int maxpairs;
+    int xl;
+    int xh;
+    int y;
+    int n;
+    int i;
+
+    pairs = NULL;
+    maxpairs = 0;
+    counts = malloc(bmapwidth * sizeof(int));
+
+    while(1) {
+        SDL_LockMutex(bmaplock);
+        y = nextbmaprow++;
+        SDL_UnlockMutex(bmaplock);
+
+        if(y >= bmapheight) {
+            break;
+        }
+
+        // at most one pair for each block a line's bbox spans
+        n = 0;
+
+        for(i = rowfirst[y]; i < rowfirst[y + 1]; i++) {
+            line_t *ld = &lines[rowlines[i]];
+
+            P_BlockRange(ld->bbox[BOXLEFT], ld->bbox[BOXRIGHT], bmaporgx, bmapwidth, &xl, &xh);
+            n += xh - xl + 1;
+        }
+
+        if(n > maxpairs) {
+            maxpairs = n;
+
+            if(!(pairs = realloc(pairs, maxpairs * 2 * sizeof(int)))) {
+                I_Error("P_CreateBlockMap: Couldn't realloc %i pairs", maxpairs);
+            }
+        }
+
+        P_BlockMapRow(y, pairs, counts);
+    }
+
+    free(pairs);
+    free(counts);
+
+    return 0;
+}
+
+//
+// P_CreateBlockMap
+// blocksize is in map units and must be a power of two
+//
+
+void P_CreateBlockMap(int blocksize) {
+    SDL_Thread *threads[BLOCKMAP_MAXTHREADS];
+    int minx;
+    int miny;
+    int maxx;
+    int maxy;
+    int orgx;
+    int orgy;
+    int numthreads;
+    int numlists;
+    int count;
+    int *out;
+    int yl;
+    int yh;
+    int i;
+    int y;
+    int x;
+
+    for(bmapshift = 0; (1 << (bmapshift + 1)) <= blocksize; bmapshift++);
+
+    // worked out in whole map units like the lump header,
+    // a wide map's extent doesn't fit in fixed point
+    minx = miny = D_MAXINT;
+    maxx = maxy = D_MININT;
+
+    for(i = 0; i < numvertexes; i++) {
+        minx = MIN(minx, F2INT(vertexes[i].x));
+        miny = MIN(miny, F2INT(vertexes[i].y));
+        maxx = MAX(maxx, F2INT(vertexes[i].x));
+        maxy = MAX(maxy, F2INT(vertexes[i].y));
+    }
+
+    if(!numvertexes) {
+        minx = miny = maxx = maxy = 0;
+    }
+
+    // the origin itself still has to fit in fixed point
+    orgx = MAX(minx - 8, D_MININT >> FRACBITS);
+    orgy = MAX(miny - 8, D_MININT >> FRACBITS);
+
+    bmaporgx = INT2F(orgx);
+    bmaporgy = INT2F(orgy);
+    bmapwidth = ((maxx - orgx) >> bmapshift) + 1;
+    bmapheight = ((maxy - orgy) >> bmapshift) + 1;
+
+    // bin the lines by row
+    rowfirst = calloc(bmapheight + 1, sizeof(int));
+
+    for(i = 0; i < numlines; i++) {
+        P_BlockRange(lines[i].bbox[BOXBOTTOM], lines[i].bbox[BOXTOP], bmaporgy, bmapheight, &yl, &yh);
+
+        for(y = yl; y <= yh; y++) {
+            rowfirst[y + 1]++;
+        }
+    }
+
+    for(y = 0; y < bmapheight; y++) {
+        rowfirst[y + 1] += rowfirst[y];
+    }
+
+    rowlines = malloc(MAX(rowfirst[bmapheight], 1) * sizeof(int));
+
+    for(i = 0; i < numlines; i++) {
+        P_BlockRange(lines[i].bbox[BOXBOTTOM], lines[i].bbox[BOXTOP], bmaporgy, bmapheight, &yl, &yh);
+
+        for(y = yl; y <= yh; y++) {
+            rowlines[rowfirst[y]++] = i;
+        }
+    }
+
+    // filling in moved each row's start to the next row's
+    for(y = bmapheight; y > 0; y--) {
+        rowfirst[y] = rowfirst[y - 1];
+    }
+
+    rowfirst[0] = 0;
+
+    bmaprows = calloc(bmapheight, sizeof(bmaprow_t));
+    bmaplock = SDL_CreateMutex();
+    nextbmaprow = 0;
+
+    // the calling thread always takes part, so a
+    // failed thread creation only costs time
+    numthreads = 0;
+    count = MIN(SDL_GetCPUCount(), BLOCKMAP_MAXTHREADS);
+
+    for(i = 1; i < count && i < bmapheight; i++) {
+        if((threads[numthreads] = SDL_CreateThread(P_BlockMapThread, "BlockMap", NULL))) {
+            numthreads++;
+        }
+    }
+
+    P_BlockMapThread(NULL);
+
+    for(i = 0; i < numthreads; i++) {
+        SDL_WaitThread(threads[i], NULL);
+    }
+
+    SDL_DestroyMutex(bmaplock);
+    bmaplock = NULL;
+
+    // header, offsets, the shared empty list, then every row's lists
+    numlists = 1;
+
+    for(y = 0; y < bmapheight; y++) {
+        numlists += bmaprows[y].count;
+    }
+
+    count = 4 + bmapwidth * bmapheight + numlists;
+
+    blockmaplump = Z_Malloc(count * sizeof(int), PU_LEVEL, NULL);
+    blockmap = blockmaplump + 4;
+
+    blockmaplump[0] = orgx;
+    blockmaplump[1] = orgy;
+    blockmaplump[2] = bmapwidth;
+    blockmaplump[3] = bmapheight;
+
+    out = blockmap + bmapwidth * bmapheight;
+    *out++ = -1;
+
+    for(y = 0; y < bmapheight; y++) {
+        bmaprow_t *row = &bmaprows[y];
+        int base = out - blockmaplump;
+
+        for(x = 0; x < bmapwidth; x++) {
+            blockmap[y * bmapwidth + x] = row->start[x] == -1 ?
+                                          (4 + bmapwidth * bmapheight) : base + row->start[x];
+        }
+
+        dmemcpy(out, row->data, row->count * sizeof(int));
+        out += row->count;
+
+        free(row->data);
+        free(row->start);
+    }
+
+    free(bmaprows);
+    free(rowlines);
+    free(rowfirst);
+    bmaprows = NULL;
+    rowlines = NULL;
+    rowfirst = NULL;
+}
@@ -101,7 +101,7 @@ mobj_t* soundtarget;
 
 void P_RecursiveSound(sector_t* sec, int soundblocks) {
     int        i;
-    line_t*    check;
+    sectoredge_t*    edge;
     sector_t*    other;
 
     // wake up all monsters in this sector
@@ -114,26 +114,20 @@ void P_RecursiveSound(sector_t* sec, int soundblocks) {
 
     P_SetTarget(&sec->soundtarget, soundtarget);
 
-    for(i = 0; i < sec->linecount; i++) {
-        check = sec->lines[i];
-        if(!(check->flags & ML_TWOSIDED)) {
+    for(i = 0, edge = sec->edges; i < sec->edgecount; i++, edge++) {
+        if(!(edge->flags & SEF_TWOSIDED)) {
             continue;
         }
 
-        P_LineOpening(check);
+        other = edge->other;
 
-        if(openrange <= 0) {
+        // same test as P_LineOpening, without its globals
+        if(MIN(sec->ceilingheight, other->ceilingheight) <=
+                MAX(sec->floorheight, other->floorheight)) {
             continue;    // closed door
         }
 
-        if(sides[check->sidenum[0] ].sector == sec) {
-            other = sides[check->sidenum[1]].sector;
-        }
-        else {
-            other = sides[check->sidenum[0]].sector;
-        }
-
-        if(check->flags & ML_SOUNDBLOCK) {
+        if(edge->flags & SEF_SOUNDBLOCK) {
             if(!soundblocks) {
                 P_RecursiveSound(other, 1);
             }
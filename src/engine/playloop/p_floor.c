@@ -49,6 +49,10 @@ result_e T_MovePlane(sector_t* sector, fixed_t speed, fixed_t dest,
     dboolean flag;
     fixed_t lastpos;
 
+    // not every branch below goes through P_ChangeSector,
+    // a rising ceiling doesn't, but all of them move a plane
+    P_SightSectorChanged(sector);
+
     switch(floorOrCeiling) {
     case 0:
         // FLOOR
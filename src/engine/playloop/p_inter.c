@@ -997,6 +997,8 @@ void P_DamageMobj(mobj_t* target, mobj_t* inflictor, mobj_t* source, int damage)
         return;
     }
 
+    P_WakeMobj(target);
+
     if(source && target) {
         if(source->player &&
                 (target->player && target->player != source->player) &&
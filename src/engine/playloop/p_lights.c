@@ -167,6 +167,30 @@ void T_StrobeFlash(strobe_t* flash) {
 
 
 
+//
+// P_LightCountdown
+// Flickers, flashes and strobes do nothing until their
+// counter runs out, so they can be left parked until then
+//
+
+int *P_LightCountdown(thinker_t* thinker) {
+    actionf_p1 func = thinker->function.acp1;
+
+    if(func == (actionf_p1)T_FireFlicker) {
+        return &((fireflicker_t*)thinker)->count;
+    }
+
+    if(func == (actionf_p1)T_LightFlash) {
+        return &((lightflash_t*)thinker)->count;
+    }
+
+    if(func == (actionf_p1)T_StrobeFlash) {
+        return &((strobe_t*)thinker)->count;
+    }
+
+    return NULL;
+}
+
 //
 // P_SpawnStrobeFlash
 // After the map has been loaded, scan each sector
@@ -535,8 +559,6 @@ void P_CombineLightSpecials(sector_t *sector) {
 //
 //------------------------------------------------------------------------
 
-int P_FindSectorFromTag(int tag);
-
 //
 // T_LightMorph
 //
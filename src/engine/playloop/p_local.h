@@ -31,6 +31,7 @@
 #include "info.h"
 #include "m_menu.h"
 #include "t_bsp.h"
+#include "z_zone.h"
 
 #define FLOATSPEED        (FRACUNIT*4)
 
@@ -39,10 +40,11 @@
 #define VIEWHEIGHT        (56*FRACUNIT)    //villsa: changed from 41 to 56
 
 // mapblocks are used to check movement
-// against lines and things
-#define MAPBLOCKUNITS    128
+// against lines and things. Shipped blockmaps
+// are always 128 units, built ones can vary
+#define MAPBLOCKUNITS    (1<<bmapshift)
 #define MAPBLOCKSIZE    (MAPBLOCKUNITS*FRACUNIT)
-#define MAPBLOCKSHIFT    (FRACBITS+7)
+#define MAPBLOCKSHIFT    (FRACBITS+bmapshift)
 #define MAPBMASK        (MAPBLOCKSIZE-1)
 #define MAPBTOFRAC        (MAPBLOCKSHIFT-FRACBITS)
 
@@ -94,6 +96,44 @@ extern fixed_t frame_viewy;
 extern fixed_t frame_viewz;
 
 
+//
+// P_SCHED
+//
+
+#define SCHED_WHEELSIZE     256     // must be a power of two
+
+typedef struct {
+    schednode_t     run;            // nodes visited each pass, in link order
+    schednode_t     pending;        // woken ahead of the walk, merged in as it passes
+    schednode_t     deferred;       // woken behind the walk, merged next pass
+    schednode_t     wheel[SCHED_WHEELSIZE];
+    schednode_t*    cursor;
+    int             curseq;
+    int             pass;
+    int             nextseq;
+    int             numparked;
+    dboolean        running;
+} schedqueue_t;
+
+extern schedqueue_t mobjqueue;
+extern schedqueue_t thinkerqueue;
+
+void            P_SchedClear(schedqueue_t *q);
+void            P_SchedLink(schedqueue_t *q, schednode_t *node);
+void            P_SchedUnlink(schedqueue_t *q, schednode_t *node);
+void            P_SchedBeginPass(schedqueue_t *q);
+schednode_t*    P_SchedNext(schedqueue_t *q);
+void            P_SchedEndPass(schedqueue_t *q);
+dboolean        P_SchedEnabled(void);
+void            P_SchedParkMobj(mobj_t *mobj);
+void            P_SchedParkThinker(thinker_t *thinker);
+void            P_SchedVerify(void);
+void            P_WakeMobj(mobj_t *mobj);
+void            P_WakeThinker(thinker_t *thinker);
+void            P_WakeAll(void);
+
+
+
 //
 // P_PSPR
 //
@@ -147,6 +187,9 @@ void    P_ClearUserCamera(player_t* player);
 extern mapthing_t*  spawnlist;
 extern int          numspawnlist;
 
+extern zpool_t* mobjpool;
+
+mobj_t*     P_AllocMobj(void);
 mobj_t*     P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type);
 void        P_SafeRemoveMobj(mobj_t* mobj);
 void        P_RemoveMobj(mobj_t* th);
@@ -193,9 +236,10 @@ typedef struct {
     }            d;
 } intercept_t;
 
+// [d64] only kept without COMPATF_UNLIMITEDINTERCEPTS; the buffer grows as needed
 #define MAXINTERCEPTS    128
 
-extern intercept_t    intercepts[MAXINTERCEPTS];
+extern intercept_t*    intercepts;
 extern intercept_t*    intercept_p;
 
 typedef dboolean(*traverser_t)(intercept_t *in);
@@ -224,6 +268,7 @@ dboolean    P_BlockThingsIterator(int x, int y, dboolean(*func)(mobj_t*));
 extern divline_t    trace;
 
 dboolean P_PathTraverse(fixed_t x1, fixed_t y1, fixed_t x2, fixed_t y2, int    flags, dboolean(*trav)(intercept_t *));
+void P_InitTraceBench(void);
 void    P_UnsetThingPosition(mobj_t* thing);
 void    P_SetThingPosition(mobj_t* thing);
 
@@ -246,6 +291,9 @@ dboolean    P_TeleportMove(mobj_t* thing, fixed_t x, fixed_t y);
 void        P_SlideMove(mobj_t* mo);
 dboolean    P_CheckSight(mobj_t* t1, mobj_t* t2);
 void        P_ScanSights(void);
+void        P_SightSectorChanged(sector_t *sector);
+void        P_ResetSightCache(void);
+void        P_SightCacheStats(int *hits, int *misses);
 dboolean    P_UseLines(player_t* player, dboolean showcontext);
 dboolean    P_ChangeSector(sector_t* sector, dboolean crunch);
 mobj_t*     P_CheckOnMobj(mobj_t *thing);
@@ -263,18 +311,29 @@ fixed_t P_AimLineAttack(mobj_t*    t1, angle_t angle, fixed_t zheight, fixed_t d
 void    P_LineAttack(mobj_t* t1,angle_t angle, fixed_t distance, fixed_t slope, int damage);
 void    P_RadiusAttack(mobj_t* spot, mobj_t* source, int damage);
 
+//
+// P_REJECT
+//
+void        P_BuildReject(byte *reject, int size);
+
+//
+// P_BLOCKMAP
+//
+void        P_CreateBlockMap(int blocksize);
+
 
 
 //
 // P_SETUP
 //
 extern byte*        rejectmatrix;    // for fast sight rejection
-extern short*        blockmaplump;    // offsets in blockmap are from here
-extern short*        blockmap;
+extern int*        blockmaplump;    // offsets in blockmap are from here
+extern int*        blockmap;
 extern int            bmapwidth;
 extern int            bmapheight;    // in mapblocks
 extern fixed_t        bmaporgx;
 extern fixed_t        bmaporgy;    // origin of block map
+extern int            bmapshift;    // log2 of the block size in map units
 extern mobj_t**        blocklinks;    // for thing chains
 
 
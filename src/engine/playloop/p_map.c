@@ -1001,8 +1001,8 @@ fixed_t         aimslope;
 fixed_t         aimpitch;
 
 // slopes to top and bottom of target
-extern fixed_t  topslope;
-extern fixed_t  bottomslope;
+fixed_t         topslope;
+fixed_t         bottomslope;
 
 // [kex]
 extern fixed_t laserhit_x;
@@ -1669,6 +1669,8 @@ static dboolean nofit;
 dboolean PIT_ChangeSector(mobj_t* thing) {
     mobj_t* mo;
 
+    P_WakeMobj(thing);
+
     if(P_ThingHeightClip(thing)) {
         // keep checking
         return true;
@@ -1735,6 +1737,9 @@ dboolean P_ChangeSector(sector_t* sector, dboolean crunch) {
     nofit = false;
     crushchange = crunch;
 
+    // every plane mover comes through here after changing heights
+    P_SightSectorChanged(sector);
+
     // [d64] handle special case if sector's special is 666
     if(sector->special == 666) {
         crushchange = 2;
@@ -31,6 +31,8 @@
 
 #include <stdlib.h>
 
+#include "SDL.h"
+
 #include "m_misc.h"
 #include "m_fixed.h"
 #include "doomdef.h"
@@ -38,6 +40,8 @@
 #include "r_local.h"
 #include "doomstat.h"
 #include "z_zone.h"
+#include "con_console.h"
+#include "g_actions.h"
 
 
 //
@@ -382,6 +386,8 @@ P_SetThingPosition(mobj_t* thing) {
     int            blocky;
     mobj_t**        link;
 
+    // moved from outside its own thinker
+    P_WakeMobj(thing);
 
     // link into subsector
     ss = R_PointInSubsector(thing->x,thing->y);
@@ -453,7 +459,7 @@ P_BlockLinesIterator
  int            y,
  dboolean(*func)(line_t*)) {
     int            offset;
-    short*        list;
+    int*        list;
     line_t*        ld;
 
     if(x<0
@@ -521,13 +527,61 @@ P_BlockThingsIterator
 //
 // INTERCEPT ROUTINES
 //
-intercept_t    intercepts[MAXINTERCEPTS];
+intercept_t*    intercepts = NULL;
 intercept_t*    intercept_p;
+static int      maxintercepts = 0;
+static int      traversedepth = 0;
+
+#define TRACEBENCH_MAX  4096
+
+typedef struct {
+    fixed_t     x1;
+    fixed_t     y1;
+    fixed_t     x2;
+    fixed_t     y2;
+    int         flags;
+} benchtrace_t;
+
+static benchtrace_t benchtraces[TRACEBENCH_MAX];
+static int          numbenchtraces = 0;
+static dboolean     tracerecording = false;
+static dboolean     tracebenchscan = false;
 
 divline_t     trace;
 dboolean     earlyout;
 int        ptflags;
 
+//
+// P_NewIntercept
+// The buffer doubles whenever it fills up and is kept
+// between traces. Returns NULL once the N64's limit is
+// reached unless unlimited intercepts are enabled, or
+// when full while a traverse is walking the buffer, as
+// moving it would leave the outer walk pointing at freed
+// memory.
+//
+
+static intercept_t* P_NewIntercept(void) {
+    int count = intercept_p - intercepts;
+
+    // [d64] exit out if max intercepts has been hit
+    if(!(compatflags & COMPATF_UNLIMITEDINTERCEPTS) && count >= MAXINTERCEPTS) {
+        return NULL;
+    }
+
+    if(count == maxintercepts) {
+        if(traversedepth > 0) {
+            return NULL;
+        }
+
+        maxintercepts = maxintercepts ? maxintercepts * 2 : MAXINTERCEPTS;
+        intercepts = Z_Realloc(intercepts, maxintercepts * sizeof(intercept_t), PU_STATIC, NULL);
+        intercept_p = intercepts + count;
+    }
+
+    return intercept_p++;
+}
+
 //
 // PIT_AddLineIntercepts.
 // Looks for lines in the given block
@@ -544,6 +598,7 @@ PIT_AddLineIntercepts(line_t* ld) {
     int            s2;
     fixed_t        frac;
     divline_t        dl;
+    intercept_t*    in;
 
     // avoid precision problems with two routines
     if(trace.dx > FRACUNIT*16
@@ -577,16 +632,13 @@ PIT_AddLineIntercepts(line_t* ld) {
         return false;    // stop checking
     }
 
-    // [d64] exit out if max intercepts has been hit
-    if((intercept_p - intercepts) >= MAXINTERCEPTS) {
+    if(!(in = P_NewIntercept())) {
         return true;
     }
 
-
-    intercept_p->frac = frac;
-    intercept_p->isaline = true;
-    intercept_p->d.line = ld;
-    intercept_p++;
+    in->frac = frac;
+    in->isaline = true;
+    in->d.line = ld;
 
     return true;    // continue
 }
@@ -611,6 +663,8 @@ dboolean PIT_AddThingIntercepts(mobj_t* thing) {
 
     fixed_t        frac;
 
+    intercept_t*    in;
+
     tracepositive = (trace.dx ^ trace.dy)>0;
 
     // check a corner to corner crossection for hit
@@ -647,29 +701,26 @@ dboolean PIT_AddThingIntercepts(mobj_t* thing) {
         return true;    // behind source
     }
 
-    // [d64] exit out if max intercepts has been hit
-    if((intercept_p - intercepts) >= MAXINTERCEPTS) {
+    if(!(in = P_NewIntercept())) {
         return true;
     }
 
-    intercept_p->frac = frac;
-    intercept_p->isaline = false;
-    intercept_p->d.thing = thing;
-    intercept_p++;
+    in->frac = frac;
+    in->isaline = false;
+    in->d.thing = thing;
 
     return true;        // keep going
 }
 
 
 //
-// P_TraverseIntercepts
-// Returns true if the traverser function returns true
-// for all lines.
+// P_ScanIntercepts
+// The original walk, rescanning the whole list for the
+// closest intercept each time. Only kept so tracebench
+// has something to compare against.
 //
-dboolean
-P_TraverseIntercepts
-(traverser_t    func,
- fixed_t    maxfrac) {
+
+static dboolean P_ScanIntercepts(traverser_t func, fixed_t maxfrac) {
     int            count;
     fixed_t        dist;
     intercept_t*    scan;
@@ -692,19 +743,6 @@ P_TraverseIntercepts
             return true;    // checked everything in range
         }
 
-#if 0  // UNUSED
-        {
-            // don't check these yet, there may be others inserted
-            in = scan = intercepts;
-            for(scan = intercepts ; scan<intercept_p ; scan++)
-                if(scan->frac > maxfrac) {
-                    *in++ = *scan;
-                }
-            intercept_p = in;
-            return false;
-        }
-#endif
-
         if(!func(in)) {
             return false;    // don't bother going farther
         }
@@ -715,6 +753,70 @@ P_TraverseIntercepts
     return true;        // everything was traversed
 }
 
+//
+// P_SortIntercepts
+// Insertion sort by frac. Blocks are visited in order along
+// the trace, so the list comes in nearly sorted, and ties
+// keep the order they were found in like the old scan did.
+//
+
+static void P_SortIntercepts(void) {
+    intercept_t*    scan;
+    intercept_t*    in;
+    intercept_t     key;
+
+    for(scan = intercepts + 1; scan < intercept_p; scan++) {
+        if(scan->frac >= scan[-1].frac) {
+            continue;
+        }
+
+        key = *scan;
+
+        for(in = scan; in > intercepts && in[-1].frac > key.frac; in--) {
+            *in = in[-1];
+        }
+
+        *in = key;
+    }
+}
+
+//
+// P_TraverseIntercepts
+// Returns true if the traverser function returns true
+// for all lines.
+//
+dboolean
+P_TraverseIntercepts
+(traverser_t    func,
+ fixed_t    maxfrac) {
+    intercept_t*    in;
+    dboolean        result = true;
+
+    traversedepth++;
+
+    if(tracebenchscan) {
+        result = P_ScanIntercepts(func, maxfrac);
+        traversedepth--;
+        return result;
+    }
+
+    P_SortIntercepts();
+
+    for(in = intercepts; in < intercept_p; in++) {
+        if(in->frac > maxfrac) {
+            break;    // checked everything in range
+        }
+
+        if(!func(in)) {
+            result = false;    // don't bother going farther
+            break;
+        }
+    }
+
+    traversedepth--;
+    return result;        // everything was traversed
+}
+
 //
 // T_TraceDrawer
 //
@@ -755,6 +857,7 @@ P_PathTraverse
     int        mapxstep;
     int        mapystep;
     int        count;
+    int        maxsteps;
 
     if(r_drawtrace.value) {
         tracedrawer_t* tdrawer;
@@ -771,6 +874,21 @@ P_PathTraverse
         tdrawer->flags = flags;
     }
 
+    if(tracerecording) {
+        benchtrace_t* bt = &benchtraces[numbenchtraces++];
+
+        bt->x1 = x1;
+        bt->y1 = y1;
+        bt->x2 = x2;
+        bt->y2 = y2;
+        bt->flags = flags;
+
+        if(numbenchtraces == TRACEBENCH_MAX) {
+            tracerecording = false;
+            CON_Printf(WHITE, "tracebench: %i traces recorded\n", numbenchtraces);
+        }
+    }
+
     earlyout = flags & PT_EARLYOUT;
 
     D_IncValidCount();
@@ -841,7 +959,11 @@ P_PathTraverse
     mapx = xt1;
     mapy = yt1;
 
-    for(count = 0 ; count < 64 ; count++) {
+    // smaller built blocks get more steps so a
+    // trace still reaches as far as it did
+    maxsteps = bmapshift < 7 ? 64 << (7 - bmapshift) : 64;
+
+    for(count = 0 ; count < maxsteps ; count++) {
         if(flags & PT_ADDLINES) {
             if(!P_BlockLinesIterator(mapx, mapy,PIT_AddLineIntercepts)) {
                 return false;    // early out
@@ -873,5 +995,92 @@ P_PathTraverse
     return P_TraverseIntercepts(trav, FRACUNIT);
 }
 
+//
+// PTR_BenchTraverse
+// Stops where shooting and aiming would, without
+// doing anything to what it finds
+//
 
+static dboolean PTR_BenchTraverse(intercept_t* in) {
+    if(in->isaline) {
+        return (in->d.line->backsector != NULL);
+    }
 
+    return !(in->d.thing->flags & MF_SHOOTABLE);
+}
+
+//
+// CMD_TraceBench
+// "tracebench record" captures the next traces made in play,
+// "tracebench [passes]" replays them on the current map with
+// the sorted walk and with the old scan
+//
+
+static CMD(TraceBench) {
+    uint64 start;
+    double elapsed[2];
+    float drawtrace;
+    int passes;
+    int maxcount;
+    int mode;
+    int i;
+    int j;
+
+    if(param[0] && !dstrcmp(param[0], "record")) {
+        numbenchtraces = 0;
+        tracerecording = true;
+        CON_Printf(WHITE, "tracebench: recording the next %i traces\n", TRACEBENCH_MAX);
+        return;
+    }
+
+    if(gamestate != GS_LEVEL || !numbenchtraces) {
+        CON_Printf(WHITE, "tracebench: record some traces in a level first\n");
+        return;
+    }
+
+    passes = param[0] ? datoi(param[0]) : 100;
+
+    if(passes <= 0) {
+        passes = 1;
+    }
+
+    tracerecording = false;
+    drawtrace = r_drawtrace.value;
+    r_drawtrace.value = 0;
+    maxcount = 0;
+
+    for(mode = 0; mode < 2; mode++) {
+        tracebenchscan = (mode == 1);
+        start = SDL_GetPerformanceCounter();
+
+        for(i = 0; i < passes; i++) {
+            for(j = 0; j < numbenchtraces; j++) {
+                benchtrace_t* bt = &benchtraces[j];
+
+                P_PathTraverse(bt->x1, bt->y1, bt->x2, bt->y2, bt->flags, PTR_BenchTraverse);
+
+                if(intercept_p - intercepts > maxcount) {
+                    maxcount = intercept_p - intercepts;
+                }
+            }
+        }
+
+        elapsed[mode] = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 /
+                        (double)SDL_GetPerformanceFrequency();
+    }
+
+    tracebenchscan = false;
+    r_drawtrace.value = drawtrace;
+
+    CON_Printf(WHITE, "tracebench: %i traces x %i, up to %i intercepts\n",
+               numbenchtraces, passes, maxcount);
+    CON_Printf(WHITE, "sorted: %.2f ms scanned: %.2f ms\n", elapsed[0], elapsed[1]);
+}
+
+//
+// P_InitTraceBench
+//
+
+void P_InitTraceBench(void) {
+    G_AddCommand("tracebench", CMD_TraceBench, 0);
+}
@@ -62,6 +62,8 @@ void P_CreateFadeOutThinker(mobj_t* mobj, line_t* line);
 dboolean P_SetMobjState(mobj_t* mobj, statenum_t state) {
     state_t* st;
 
+    P_WakeMobj(mobj);
+
     do {
         if(!mobj->state || state == S_000) {
             mobj->state = (state_t *)S_000;
@@ -581,6 +583,28 @@ void P_MobjThinker(mobj_t* mobj) {
 }
 
 
+//
+// P_AllocMobj
+// Mobjs come out of their own pool so the ones P_RunMobjs
+// walks sit together, one per cache line aligned slot.
+// They are still freed with Z_Free.
+//
+
+zpool_t *mobjpool = NULL;
+
+mobj_t* P_AllocMobj(void) {
+    mobj_t* mobj;
+
+    if(mobjpool == NULL) {
+        mobjpool = Z_CreatePool("mobj", sizeof(mobj_t), PU_LEVEL, 64);
+    }
+
+    mobj = Z_PoolAlloc(mobjpool, NULL);
+    dmemset(mobj, 0, sizeof(*mobj));
+
+    return mobj;
+}
+
 //
 // P_SpawnMobj
 //
@@ -590,8 +614,7 @@ mobj_t* P_SpawnMobj(fixed_t x, fixed_t y, fixed_t z, mobjtype_t type) {
     state_t*    st;
     mobjinfo_t* info;
 
-    mobj = Z_Malloc(sizeof(*mobj), PU_LEVEL, NULL);
-    dmemset(mobj, 0, sizeof(*mobj));
+    mobj = P_AllocMobj();
     info = &mobjinfo[type];
 
     mobj->type      = type;
@@ -680,6 +703,8 @@ void P_SafeRemoveMobj(mobj_t* mobj) {
 //
 
 void P_RemoveMobj(mobj_t* mobj) {
+    P_WakeMobj(mobj);
+
     if(respawnspecials
             && ((mobj->flags & MF_SPECIAL)
                 && !(mobj->flags & MF_DROPPED)
@@ -948,6 +973,8 @@ int EV_FadeOutMobj(line_t* line) {
             continue;
         }
 
+        P_WakeMobj(mo);
+
         if(mo->flags & MF_SPECIAL) {
             mo->flags &= ~MF_SPECIAL;
         }
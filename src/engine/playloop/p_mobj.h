@@ -256,6 +256,9 @@ typedef struct mobj_s {
     // [kex] mobj reference id
     unsigned int        refcount;
 
+    // run list links for the tic scheduler
+    schednode_t         sched;
+
 } mobj_t;
 
 #endif
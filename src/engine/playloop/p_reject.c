@@ -0,0 +1,545 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// Copyright(C) 2007-2012 Samuel Villarreal
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+//-----------------------------------------------------------------------------
+//
+// DESCRIPTION:
+//    REJECT generation for maps that ship an empty table.
+//
+//    Every two sided line between different sectors is a portal. For
+//    each source sector the portal graph is walked depth first, and a
+//    sector counts as visible when some straight line can pass through
+//    every portal on the way to it in the right direction. Sector heights
+//    are ignored since they change during play, and so is the order the
+//    portals are crossed in, which only makes the test looser. A pair is
+//    rejected only when no line can get through, so REJECT never turns a
+//    check P_CheckSight would pass into a failure.
+//
+//    Source sectors are shared out between worker threads. The finished
+//    table is stored in the user directory, named after an MD5 of the
+//    map's geometry lumps, so each map is only built once.
+//
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "SDL.h"
+
+#include "doomdef.h"
+#include "doomstat.h"
+#include "m_fixed.h"
+#include "i_system.h"
+#include "md5.h"
+#include "w_wad.h"
+#include "p_local.h"
+#include "con_console.h"
+
+#define REJECT_ID           "REJ1"
+#define REJECT_MAXTHREADS   8
+#define REJECT_EPSILON      4.0     // map units, allows for the integer side tests
+#define REJECT_MAXWORK      0x800000    // point tests from one sector before giving up
+
+typedef struct {
+    int         sector;             // sector on the far side
+    double      lx;
+    double      ly;                 // left end when crossing
+    double      rx;
+    double      ry;                 // right end when crossing
+} portal_t;
+
+typedef struct {
+    double      a;
+    double      b;
+    double      c;                  // a*x + b*y + c, left of the line is positive
+} rejline_t;
+
+typedef struct {
+    byte*       inpath;
+    byte*       visible;
+    int*        queue;
+    double*     px;
+    double*     py;                 // left ends at even slots, right ends at odd
+    rejline_t*  witness;            // a line through the portals at each depth
+    int         numvisible;
+    int         numreachable;       // sectors connected to the source at all
+    int64       work;
+} rejctx_t;
+
+static portal_t*    portals;
+static int*         firstportal;    // numsectors + 1 entries
+static byte*        newreject;
+
+static SDL_mutex*   rejectlock = NULL;
+static int          nextrejectsector = 0;
+
+//
+// P_BuildPortals
+//
+
+static void P_BuildPortals(void) {
+    int *count;
+    line_t *line;
+    portal_t *p;
+    int i;
+
+    firstportal = calloc(numsectors + 1, sizeof(int));
+    count = calloc(numsectors, sizeof(int));
+
+    if(!firstportal || !count) {
+        I_Error("P_BuildPortals: Out of memory for %i sectors", numsectors);
+    }
+
+    for(i = 0, line = lines; i < numlines; i++, line++) {
+        if(!(line->flags & ML_TWOSIDED) || !line->frontsector || !line->backsector ||
+                line->frontsector == line->backsector) {
+            continue;
+        }
+
+        firstportal[(line->frontsector - sectors) + 1]++;
+        firstportal[(line->backsector - sectors) + 1]++;
+    }
+
+    for(i = 0; i < numsectors; i++) {
+        firstportal[i + 1] += firstportal[i];
+    }
+
+    portals = malloc(MAX(firstportal[numsectors], 1) * sizeof(portal_t));
+
+    if(!portals) {
+        I_Error("P_BuildPortals: Out of memory for %i portals", firstportal[numsectors]);
+    }
+
+    for(i = 0, line = lines; i < numlines; i++, line++) {
+        int front;
+        int back;
+
+        if(!(line->flags & ML_TWOSIDED) || !line->frontsector || !line->backsector ||
+                line->frontsector == line->backsector) {
+            continue;
+        }
+
+        front = line->frontsector - sectors;
+        back = line->backsector - sectors;
+
+        // front to back passes v1 on the left
+        p = &portals[firstportal[front] + count[front]++];
+        p->sector = back;
+        p->lx = F2D3D(line->v1->x);
+        p->ly = F2D3D(line->v1->y);
+        p->rx = F2D3D(line->v2->x);
+        p->ry = F2D3D(line->v2->y);
+
+        p = &portals[firstportal[back] + count[back]++];
+        p->sector = front;
+        p->lx = F2D3D(line->v2->x);
+        p->ly = F2D3D(line->v2->y);
+        p->rx = F2D3D(line->v1->x);
+        p->ry = F2D3D(line->v1->y);
+    }
+
+    free(count);
+}
+
+//
+// P_LineSeparates
+// Every left end on the left of the line and every
+// right end on its right, give or take the epsilon
+//
+
+static dboolean P_LineSeparates(rejctx_t *ctx, int numpoints, rejline_t *l) {
+    double d;
+    int i;
+
+    for(i = 0; i < numpoints; i++) {
+        d = l->a * ctx->px[i] + l->b * ctx->py[i] + l->c;
+
+        if((i & 1) ? (d > REJECT_EPSILON) : (d < -REJECT_EPSILON)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//
+// P_FindWitness
+// If any line separates the left and right ends, one passes
+// through two of the points, so those are all that is tried
+//
+
+static dboolean P_FindWitness(rejctx_t *ctx, int numpoints, rejline_t *l) {
+    double dx;
+    double dy;
+    double len;
+    int i;
+    int j;
+
+    ctx->work += (int64)numpoints * numpoints * numpoints;
+
+    for(i = 0; i < numpoints; i++) {
+        for(j = i + 1; j < numpoints; j++) {
+            dx = ctx->px[j] - ctx->px[i];
+            dy = ctx->py[j] - ctx->py[i];
+            len = sqrt(dx * dx + dy * dy);
+
+            if(len < 0.001) {
+                continue;
+            }
+
+            l->a = -dy / len;
+            l->b = dx / len;
+            l->c = -(l->a * ctx->px[i] + l->b * ctx->py[i]);
+
+            if(P_LineSeparates(ctx, numpoints, l)) {
+                return true;
+            }
+
+            l->a = -l->a;
+            l->b = -l->b;
+            l->c = -l->c;
+
+            if(P_LineSeparates(ctx, numpoints, l)) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+//
+// P_RejectFlow
+//
+
+static void P_RejectFlow(rejctx_t *ctx, int sector, int depth) {
+    portal_t *p;
+    rejline_t *l;
+    int numpoints;
+    int i;
+
+    for(i = firstportal[sector]; i < firstportal[sector + 1]; i++) {
+        p = &portals[i];
+
+        if(ctx->inpath[p->sector]) {
+            continue;
+        }
+
+        // nothing left to find, or taking too long
+        if(ctx->numvisible == ctx->numreachable || ctx->work > REJECT_MAXWORK) {
+            return;
+        }
+
+        ctx->work += depth + 1;
+
+        numpoints = (depth + 1) * 2;
+        ctx->px[numpoints - 2] = p->lx;
+        ctx->py[numpoints - 2] = p->ly;
+        ctx->px[numpoints - 1] = p->rx;
+        ctx->py[numpoints - 1] = p->ry;
+
+        l = &ctx->witness[depth];
+
+        // a single portal can always be crossed. Past that the line
+        // found for the parent is tried before searching again
+        if(depth >= 1) {
+            if(depth >= 2) {
+                *l = ctx->witness[depth - 1];
+            }
+
+            if((depth == 1 || !P_LineSeparates(ctx, numpoints, l)) &&
+                    !P_FindWitness(ctx, numpoints, l)) {
+                continue;
+            }
+        }
+
+        if(!ctx->visible[p->sector]) {
+            ctx->visible[p->sector] = true;
+            ctx->numvisible++;
+        }
+
+        ctx->inpath[p->sector] = true;
+
+        P_RejectFlow(ctx, p->sector, depth + 1);
+
+        ctx->inpath[p->sector] = false;
+    }
+}
+
+//
+// P_RejectFlood
+// Marks everything connected to the source and returns the
+// count. Also the fallback for sectors that take too long
+//
+
+static int P_RejectFlood(rejctx_t *ctx, int sector) {
+    int head;
+    int tail;
+    int i;
+
+    head = tail = 0;
+    ctx->queue[tail++] = sector;
+    ctx->visible[sector] = true;
+
+    while(head < tail) {
+        sector = ctx->queue[head++];
+
+        for(i = firstportal[sector]; i < firstportal[sector + 1]; i++) {
+            if(!ctx->visible[portals[i].sector]) {
+                ctx->visible[portals[i].sector] = true;
+                ctx->queue[tail++] = portals[i].sector;
+            }
+        }
+    }
+
+    return tail;
+}
+
+//
+// P_RejectThread
+//
+
+static int SDLCALL P_RejectThread(void *data) {
+    rejctx_t ctx;
+    int sector;
+    int i;
+
+    ctx.inpath = calloc(numsectors, 1);
+    ctx.visible = malloc(numsectors);
+    ctx.queue = malloc(numsectors * sizeof(int));
+    ctx.px = malloc((numsectors + 1) * 2 * sizeof(double));
+    ctx.py = malloc((numsectors + 1) * 2 * sizeof(double));
+    ctx.witness = malloc((numsectors + 1) * sizeof(rejline_t));
+
+    if(!ctx.inpath || !ctx.visible || !ctx.queue || !ctx.px || !ctx.py || !ctx.witness) {
+        I_Error("P_RejectThread: Out of memory for %i sectors", numsectors);
+    }
+
+    while(1) {
+        SDL_LockMutex(rejectlock);
+        sector = nextrejectsector++;
+        SDL_UnlockMutex(rejectlock);
+
+        if(sector >= numsectors) {
+            break;
+        }
+
+        dmemset(ctx.visible, 0, numsectors);
+        ctx.numreachable = P_RejectFlood(&ctx, sector);
+
+        dmemset(ctx.visible, 0, numsectors);
+        ctx.visible[sector] = true;
+        ctx.inpath[sector] = true;
+        ctx.numvisible = 1;
+        ctx.work = 0;
+
+        P_RejectFlow(&ctx, sector, 0);
+
+        ctx.inpath[sector] = false;
+
+        if(ctx.work > REJECT_MAXWORK) {
+            dmemset(ctx.visible, 0, numsectors);
+            P_RejectFlood(&ctx, sector);
+        }
+
+        // rows don't start on byte boundaries
+        SDL_LockMutex(rejectlock);
+
+        for(i = 0; i < numsectors; i++) {
+            int pnum = sector * numsectors + i;
+
+            if(!ctx.visible[i]) {
+                newreject[pnum >> 3] |= (1 << (pnum & 7));
+            }
+        }
+
+        SDL_UnlockMutex(rejectlock);
+    }
+
+    free(ctx.inpath);
+    free(ctx.visible);
+    free(ctx.queue);
+    free(ctx.px);
+    free(ctx.py);
+    free(ctx.witness);
+
+    return 0;
+}
+
+//
+// P_GenerateReject
+//
+
+static void P_GenerateReject(byte *reject, int size) {
+    SDL_Thread *threads[REJECT_MAXTHREADS];
+    int numthreads;
+    int count;
+    int i;
+    int j;
+
+    newreject = reject;
+    dmemset(newreject, 0, size);
+
+    P_BuildPortals();
+
+    rejectlock = SDL_CreateMutex();
+    nextrejectsector = 0;
+
+    // the calling thread always takes part, so a
+    // failed thread creation only costs time
+    numthreads = 0;
+    count = MIN(SDL_GetCPUCount(), REJECT_MAXTHREADS);
+
+    for(i = 1; i < count && i < numsectors; i++) {
+        if((threads[numthreads] = SDL_CreateThread(P_RejectThread, "Reject", NULL))) {
+            numthreads++;
+        }
+    }
+
+    P_RejectThread(NULL);
+
+    for(i = 0; i < numthreads; i++) {
+        SDL_WaitThread(threads[i], NULL);
+    }
+
+    SDL_DestroyMutex(rejectlock);
+    rejectlock = NULL;
+
+    // a pair is only rejected if neither side can see the other
+    for(i = 0; i < numsectors; i++) {
+        for(j = i + 1; j < numsectors; j++) {
+            int p1 = i * numsectors + j;
+            int p2 = j * numsectors + i;
+
+            if(!(reject[p1 >> 3] & (1 << (p1 & 7))) || !(reject[p2 >> 3] & (1 << (p2 & 7)))) {
+                reject[p1 >> 3] &= ~(1 << (p1 & 7));
+                reject[p2 >> 3] &= ~(1 << (p2 & 7));
+            }
+        }
+    }
+
+    free(portals);
+    free(firstportal);
+    portals = NULL;
+    firstportal = NULL;
+    newreject = NULL;
+}
+
+//
+// P_RejectFileName
+//
+
+static char *P_RejectFileName(void) {
+    md5_context_t md5_context;
+    md5_digest_t digest;
+    char name[64];
+    int lumps[4] = { ML_VERTEXES, ML_LINEDEFS, ML_SIDEDEFS, ML_SECTORS };
+    int i;
+
+    MD5_Init(&md5_context);
+
+    for(i = 0; i < 4; i++) {
+        MD5_UpdateInt32(&md5_context, W_MapLumpLength(lumps[i]));
+        MD5_Update(&md5_context, (byte*)W_GetMapLump(lumps[i]), W_MapLumpLength(lumps[i]));
+    }
+
+    MD5_Final(digest, &md5_context);
+
+    dstrcpy(name, "reject_");
+
+    for(i = 0; i < 16; i++) {
+        sprintf(name + 7 + i * 2, "%02x", digest[i]);
+    }
+
+    dstrcat(name, ".dat");
+
+    return I_GetUserFile(name);
+}
+
+//
+// P_ReadRejectFile
+//
+
+static dboolean P_ReadRejectFile(const char *path, byte *reject, int size) {
+    FILE *f;
+    char id[4];
+    int count;
+    dboolean ok;
+
+    if(!(f = fopen(path, "rb"))) {
+        return false;
+    }
+
+    ok = (fread(id, 1, 4, f) == 4 && !dstrncmp(id, REJECT_ID, 4) &&
+          fread(&count, sizeof(int), 1, f) == 1 && count == numsectors &&
+          fread(reject, 1, size, f) == (size_t)size);
+
+    fclose(f);
+
+    return ok;
+}
+
+//
+// P_WriteRejectFile
+//
+
+static void P_WriteRejectFile(const char *path, byte *reject, int size) {
+    FILE *f;
+
+    if(!(f = fopen(path, "wb"))) {
+        return;
+    }
+
+    fwrite(REJECT_ID, 1, 4, f);
+    fwrite(&numsectors, sizeof(int), 1, f);
+    fwrite(reject, 1, size, f);
+
+    fclose(f);
+}
+
+//
+// P_BuildReject
+// Fills in a REJECT table for the current map, from the
+// user directory if it was built before. Needs the lines
+// and sectors loaded and the map lump still cached
+//
+
+void P_BuildReject(byte *reject, int size) {
+    char *path;
+    int starttime;
+
+    path = P_RejectFileName();
+
+    if(path && P_ReadRejectFile(path, reject, size)) {
+        free(path);
+        return;
+    }
+
+    starttime = I_GetTimeMS();
+
+    P_GenerateReject(reject, size);
+
+    CON_DPrintf("P_BuildReject: %i sectors in %ims\n", numsectors, I_GetTimeMS() - starttime);
+
+    if(path) {
+        P_WriteRejectFile(path, reject, size);
+        free(path);
+    }
+}
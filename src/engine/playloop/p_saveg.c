@@ -28,6 +28,10 @@
 //-----------------------------------------------------------------------------
 
 #include <time.h> // [kex] - for saving the date and time
+#include <stdlib.h>
+#include <zlib.h>
+
+#include "SDL.h"
 
 #include "i_system.h"
 #include "g_game.h"
@@ -37,10 +41,19 @@
 #include "doomstat.h"
 #include "info.h"
 #include "m_password.h"
+#include "m_random.h"
 #include "p_saveg.h"
 #include "d_englsh.h"
 #include "m_misc.h"
 #include "doomdef.h" // added just so MSVC would shut up about warning C4761
+#include "con_console.h"
+#include "g_actions.h"
+
+CVAR_EXTERNAL(p_savecompress);
+CVAR_EXTERNAL(p_rewind);
+CVAR_EXTERNAL(p_rewindseconds);
+CVAR_EXTERNAL(p_rewindtics);
+CVAR_EXTERNAL(p_rewindbudget);
 
 void G_DoLoadLevel(void);
 
@@ -51,11 +64,41 @@ void G_DoLoadLevel(void);
 #define SAVEGAME_EOF    0x464F45
 #define SAVEGAME_MOBJ   0x4A424F4D
 
-static FILE*    save_stream;
+//
+// compressed container. Older saves are the raw stream
+// with no header, which never starts with this id
+//
+
+#define SAVEGAME_ID         "\x89" "DSG"
+#define SAVEGAME_VERSION    1
+#define SAVEGAME_HEADERSIZE 20
+
+enum {
+    SAVEGAME_STORED,
+    SAVEGAME_DEFLATE
+};
+
+// reading uses a zone buffer, writing a malloc'd one
+// that is handed over to the writer thread
 static byte*    savebuffer;
+static unsigned long save_maxsize = 0;
 
 static unsigned long save_offset = 0;
 
+typedef struct {
+    FILE*           stream;
+    char*           name;
+    char*           tmpname;
+    byte*           data;
+    unsigned long   size;
+    dboolean        compress;
+    dboolean        failed;
+    SDL_atomic_t    done;
+} savejob_t;
+
+static savejob_t    savejob;
+static SDL_Thread*  savethread = NULL;
+
 //
 // P_GetSaveGameName
 //
@@ -82,8 +125,16 @@ static byte saveg_read8(void) {
 }
 
 static void saveg_write8(byte value) {
-    fwrite(&value, 1, 1, save_stream);
-    save_offset++;
+    if(save_offset >= save_maxsize) {
+        save_maxsize <<= 1;
+        savebuffer = realloc(savebuffer, save_maxsize);
+
+        if(savebuffer == NULL) {
+            I_Error("saveg_write8: Out of memory for %lu bytes", save_maxsize);
+        }
+    }
+
+    savebuffer[save_offset++] = value;
 }
 
 static short saveg_read16(void) {
@@ -168,8 +219,16 @@ typedef struct {
 } savegmobj_t;
 
 static savegmobj_t* savegmobj;
+static savegmobj_t* savegmobjsorted;    // by address, for writing references
 static int          savegmobjnum;
 
+static int saveg_cmpmobj(const void* a, const void* b) {
+    const mobj_t* ma = ((const savegmobj_t*)a)->mobj;
+    const mobj_t* mb = ((const savegmobj_t*)b)->mobj;
+
+    return ma < mb ? -1 : (ma > mb ? 1 : 0);
+}
+
 static void saveg_setup_mobjwrite(void) {
     mobj_t* mobj;
     int i;
@@ -201,6 +260,10 @@ static void saveg_setup_mobjwrite(void) {
         savegmobj[i].mobj = mobj;
         i++;
     }
+
+    savegmobjsorted = (savegmobj_t*)Z_Alloca(sizeof(savegmobj_t) * savegmobjnum);
+    dmemcpy(savegmobjsorted, savegmobj, sizeof(savegmobj_t) * savegmobjnum);
+    qsort(savegmobjsorted, savegmobjnum, sizeof(savegmobj_t), saveg_cmpmobj);
 }
 
 static void saveg_setup_mobjread(void) {
@@ -213,36 +276,30 @@ static void saveg_setup_mobjread(void) {
     // read and add mobjs
     for(i = 0; i < savegmobjnum; i++) {
         savegmobj[i].index = i + 1;
-        savegmobj[i].mobj = Z_Calloc(sizeof(mobj_t), PU_LEVEL, NULL);
+        savegmobj[i].mobj = P_AllocMobj();
     }
 }
 
 static void saveg_write_mobjindex(mobj_t* mobj) {
-    int i;
+    savegmobj_t key;
+    savegmobj_t* found;
 
-    for(i = 0; i < savegmobjnum; i++) {
-        if(savegmobj[i].mobj != mobj) {
-            continue;
-        }
+    key.mobj = mobj;
+    found = NULL;
 
-        saveg_write32(savegmobj[i].index);
-        return;
+    if(mobj && savegmobjnum) {
+        found = bsearch(&key, savegmobjsorted, savegmobjnum, sizeof(savegmobj_t), saveg_cmpmobj);
     }
 
-    saveg_write32(0);
+    saveg_write32(found ? found->index : 0);
 }
 
 static mobj_t* saveg_read_mobjindex(void) {
     int index = saveg_read32();
 
-    if(index) {
-        int i;
-
-        for(i = 0; i < savegmobjnum; i++) {
-            if(savegmobj[i].index == index) {
-                return savegmobj[i].mobj;
-            }
-        }
+    // indexes are table positions plus one
+    if(index > 0 && index <= savegmobjnum) {
+        return savegmobj[index - 1].mobj;
     }
 
     return NULL;
@@ -1058,49 +1115,14 @@ static void saveg_read_laserthinker_t(laserthinker_t* laserthinker) {
 //
 //------------------------------------------------------------------------
 
-static char* saveg_gettime(void) {
-    time_t clock;
-    struct tm* lt;
-
-    time(&clock);
-    lt = localtime(&clock);
-    return asctime(lt);
-}
+//
+// saveg_write_gamestate
+// The part of the header needed to rebuild the level,
+// also the start of every in-memory snapshot
+//
 
-static void saveg_write_header(char *description) {
+static void saveg_write_gamestate(void) {
     int i;
-    int size;
-    char date[32];
-    byte* tbn;
-
-    for(i = 0; description[i] != '\0'; i++) {
-        saveg_write8(description[i]);
-    }
-
-    for(; i < SAVESTRINGSIZE; i++) {
-        saveg_write8(0);
-    }
-
-    sprintf(date, "%s", saveg_gettime());
-    size = dstrlen(date);
-
-    for(i = 0; i < size; i++) {
-        saveg_write8(date[i]);
-    }
-
-    for(; i < 32; i++) {
-        saveg_write8(0);
-    }
-
-    size = M_CacheThumbNail(&tbn);
-
-    saveg_write32(size);
-
-    for(i = 0; i < size; i++) {
-        saveg_write8(tbn[i]);
-    }
-
-    Z_Free(tbn);
 
     for(i = 0; i < 16; i++) {
         saveg_write8(passwordData[i]);
@@ -1130,28 +1152,14 @@ static void saveg_write_header(char *description) {
     saveg_write_pad();
 }
 
-static void saveg_read_header(void) {
+//
+// saveg_read_gamestate
+//
+
+static void saveg_read_gamestate(void) {
     int i;
-    int size;
     byte a, b, c;
 
-    // skip the description field
-    for(i = 0; i < SAVESTRINGSIZE; i++) {
-        saveg_read8();
-    }
-
-    // skip the date
-    for(i = 0; i < 32; i++) {
-        saveg_read8();
-    }
-
-    size = saveg_read32() / sizeof(int);
-
-    // skip the thumbnail
-    for(i = 0; i < size; i++) {
-        saveg_read32();
-    }
-
     for(i = 0; i < 16; i++) {
         passwordData[i] = saveg_read8();
     }
@@ -1187,6 +1195,77 @@ static void saveg_read_header(void) {
     saveg_read_pad();
 }
 
+static char* saveg_gettime(void) {
+    time_t clock;
+    struct tm* lt;
+
+    time(&clock);
+    lt = localtime(&clock);
+    return asctime(lt);
+}
+
+static void saveg_write_header(char *description) {
+    int i;
+    int size;
+    char date[32];
+    byte* tbn;
+
+    for(i = 0; description[i] != '\0'; i++) {
+        saveg_write8(description[i]);
+    }
+
+    for(; i < SAVESTRINGSIZE; i++) {
+        saveg_write8(0);
+    }
+
+    sprintf(date, "%s", saveg_gettime());
+    size = dstrlen(date);
+
+    for(i = 0; i < size; i++) {
+        saveg_write8(date[i]);
+    }
+
+    for(; i < 32; i++) {
+        saveg_write8(0);
+    }
+
+    size = M_CacheThumbNail(&tbn);
+
+    saveg_write32(size);
+
+    for(i = 0; i < size; i++) {
+        saveg_write8(tbn[i]);
+    }
+
+    Z_Free(tbn);
+
+    saveg_write_gamestate();
+}
+
+static void saveg_read_header(void) {
+    int i;
+    int size;
+
+    // skip the description field
+    for(i = 0; i < SAVESTRINGSIZE; i++) {
+        saveg_read8();
+    }
+
+    // skip the date
+    for(i = 0; i < 32; i++) {
+        saveg_read8();
+    }
+
+    size = saveg_read32() / sizeof(int);
+
+    // skip the thumbnail
+    for(i = 0; i < size; i++) {
+        saveg_read32();
+    }
+
+    saveg_read_gamestate();
+}
+
 //------------------------------------------------------------------------
 //
 // Read/write consistency marker
@@ -1207,26 +1286,265 @@ static void saveg_write_marker(int marker) {
     saveg_write32(marker);
 }
 
+//------------------------------------------------------------------------
+//
+// Container and background writer
+//
+//------------------------------------------------------------------------
+
+static void saveg_put32(byte* p, unsigned int value) {
+    p[0] = value & 0xff;
+    p[1] = (value >> 8) & 0xff;
+    p[2] = (value >> 16) & 0xff;
+    p[3] = (value >> 24) & 0xff;
+}
+
+static unsigned int saveg_get32(byte* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+//
+// saveg_replace
+// Moves the new save over the old one. POSIX rename does that in
+// one step, but on Windows it won't replace a file, so the old save
+// is moved aside first and put back if the new one can't go in
+//
+
+static dboolean saveg_replace(const char *from, const char *to) {
+#ifdef _WIN32
+    char *bakname;
+    dboolean hadold;
+    dboolean ok;
+
+    bakname = malloc(dstrlen(to) + 5);
+    sprintf(bakname, "%s.bak", to);
+
+    remove(bakname);
+    hadold = (rename(to, bakname) == 0);
+    ok = (rename(from, to) == 0);
+
+    if(hadold) {
+        if(ok) {
+            remove(bakname);
+        }
+        else {
+            rename(bakname, to);
+        }
+    }
+
+    free(bakname);
+    return ok;
+#else
+    return rename(from, to) == 0;
+#endif
+}
+
+//
+// saveg_writethread
+// Compresses the stream and writes it out to a temporary
+// file, which then replaces the old save. Only touches the
+// job, so nothing here can go near the zone or the console
+//
+
+static int SDLCALL saveg_writethread(void *data) {
+    savejob_t *job = (savejob_t*)data;
+    byte header[SAVEGAME_HEADERSIZE];
+    byte *out;
+    uLongf outlen;
+    dboolean ok;
+
+    out = NULL;
+    outlen = 0;
+
+    if(job->compress) {
+        outlen = compressBound(job->size);
+        out = malloc(outlen);
+
+        if(out == NULL || compress2(out, &outlen, job->data, job->size, Z_BEST_SPEED) != Z_OK) {
+            free(out);
+            out = NULL;
+        }
+    }
+
+    if(out) {
+        dmemcpy(header, SAVEGAME_ID, 4);
+        saveg_put32(header + 4, SAVEGAME_VERSION);
+        saveg_put32(header + 8, SAVEGAME_DEFLATE);
+        saveg_put32(header + 12, job->size);
+        saveg_put32(header + 16, outlen);
+
+        ok = fwrite(header, 1, SAVEGAME_HEADERSIZE, job->stream) == SAVEGAME_HEADERSIZE &&
+             fwrite(out, 1, outlen, job->stream) == outlen;
+
+        free(out);
+    }
+    else {
+        // uncompressed saves keep the old layout
+        ok = fwrite(job->data, 1, job->size, job->stream) == job->size;
+    }
+
+    if(fclose(job->stream)) {
+        ok = false;
+    }
+
+    if(ok) {
+        ok = saveg_replace(job->tmpname, job->name);
+    }
+
+    if(!ok) {
+        remove(job->tmpname);
+    }
+
+    free(job->data);
+    job->data = NULL;
+    job->stream = NULL;
+    job->failed = !ok;
+
+    SDL_AtomicSet(&job->done, 1);
+
+    return 0;
+}
+
+//
+// P_WaitSaveGame
+// Blocks until the last save is on disk. Anything
+// that reads or writes a save file goes through here
+//
+
+dboolean P_WaitSaveGame(void) {
+    dboolean ok;
+
+    if(savethread == NULL && savejob.name == NULL) {
+        return true;
+    }
+
+    if(savethread) {
+        SDL_WaitThread(savethread, NULL);
+        savethread = NULL;
+    }
+
+    ok = !savejob.failed;
+
+    if(!ok) {
+        CON_Warnf("P_WaitSaveGame: Couldn't write %s\n", savejob.name);
+    }
+
+    free(savejob.name);
+    free(savejob.tmpname);
+    savejob.name = NULL;
+    savejob.tmpname = NULL;
+
+    return ok;
+}
+
+//
+// saveg_open
+// Reads a save into savebuffer, unpacking it if it is in
+// the container. Returns the stream length or -1
+//
+
+static int saveg_open(char* name) {
+    byte *data;
+    unsigned int version;
+    unsigned int method;
+    uLongf rawsize;
+    unsigned int packedsize;
+    int length;
+
+    P_WaitSaveGame();
+
+    if((length = M_ReadFile(name, &savebuffer)) == -1) {
+        return -1;
+    }
+
+    save_offset = 0;
+
+    if(length < SAVEGAME_HEADERSIZE || dstrncmp((char*)savebuffer, SAVEGAME_ID, 4)) {
+        return length;
+    }
+
+    version = saveg_get32(savebuffer + 4);
+    method = saveg_get32(savebuffer + 8);
+    rawsize = saveg_get32(savebuffer + 12);
+    packedsize = saveg_get32(savebuffer + 16);
+
+    // a stored block has to hold the whole game, or the
+    // rest of it would be read from uninitialised memory
+    if(version > SAVEGAME_VERSION || method > SAVEGAME_DEFLATE || !rawsize ||
+            packedsize > (unsigned int)(length - SAVEGAME_HEADERSIZE) ||
+            (method == SAVEGAME_STORED && packedsize != rawsize)) {
+        CON_Warnf("saveg_open: %s is not a supported savegame\n", name);
+        Z_Free(savebuffer);
+        return -1;
+    }
+
+    data = Z_Malloc(rawsize, PU_STATIC, 0);
+
+    if(method == SAVEGAME_DEFLATE) {
+        uLongf outlen = rawsize;
+
+        if(uncompress(data, &outlen, savebuffer + SAVEGAME_HEADERSIZE, packedsize) != Z_OK ||
+                outlen != rawsize) {
+            CON_Warnf("saveg_open: %s is damaged\n", name);
+            Z_Free(data);
+            Z_Free(savebuffer);
+            return -1;
+        }
+    }
+    else {
+        dmemcpy(data, savebuffer + SAVEGAME_HEADERSIZE, rawsize);
+    }
+
+    Z_Free(savebuffer);
+    savebuffer = data;
+
+    return rawsize;
+}
+
 //
 // P_WriteSaveGame
+// The game is serialized into memory here and then handed
+// to a thread to be compressed and written, so the file
+// may not be complete until P_WaitSaveGame returns
 //
 
 dboolean P_WriteSaveGame(char* description, int slot) {
-    //char name[256];
+    char *name;
+    char *tmpname;
+    FILE *stream;
 
-    // setup game save file
-    // sprintf(name, SAVEGAMENAME"%d.dsg", slot);
-    save_stream = fopen(P_GetSaveGameName(slot), "wb");
+    // only one save in flight at a time
+    P_WaitSaveGame();
+
+    if(!(name = P_GetSaveGameName(slot))) {
+        return false;
+    }
+
+    tmpname = malloc(dstrlen(name) + 5);
+    sprintf(tmpname, "%s.tmp", name);
+
+    stream = fopen(tmpname, "wb");
 
     // success?
-    if(save_stream == NULL) {
+    if(stream == NULL) {
+        free(tmpname);
+        free(name);
         return false;
     }
 
+    save_maxsize = SAVEGAMESIZE;
+    savebuffer = malloc(save_maxsize);
     save_offset = 0;
 
+    if(savebuffer == NULL) {
+        I_Error("P_WriteSaveGame: Out of memory for %lu bytes", save_maxsize);
+    }
+
     saveg_write_header(description);
 
+    // parked mobjs and thinkers have stale counters
+    P_WakeAll();
+
     P_ArchiveMobjs();
     P_ArchivePlayers();
     P_ArchiveWorld();
@@ -1235,19 +1553,50 @@ dboolean P_WriteSaveGame(char* description, int slot) {
 
     saveg_write_marker(SAVEGAME_EOF);
 
-    // close out file
-    fclose(save_stream);
+    savejob.stream = stream;
+    savejob.name = name;
+    savejob.tmpname = tmpname;
+    savejob.data = savebuffer;
+    savejob.size = save_offset;
+    savejob.compress = (p_savecompress.value > 0);
+    savejob.failed = false;
+    SDL_AtomicSet(&savejob.done, 0);
+
+    savebuffer = NULL;
+    save_maxsize = 0;
+
+    // write it here if there's no thread to do it,
+    // P_PollSaveGame reports the result either way
+    if(!(savethread = SDL_CreateThread(saveg_writethread, "SaveGame", &savejob))) {
+        saveg_writethread(&savejob);
+    }
 
     return true;
 }
 
+//
+// P_PollSaveGame
+// Returns true once, when the save in flight has
+// finished, with ok telling whether it was written
+//
+
+dboolean P_PollSaveGame(dboolean *ok) {
+    if(savejob.name == NULL || !SDL_AtomicGet(&savejob.done)) {
+        return false;
+    }
+
+    *ok = P_WaitSaveGame();
+    return true;
+}
+
 //
 // P_ReadSaveGame
 //
 
 dboolean P_ReadSaveGame(char* name) {
-    M_ReadFile(name, &savebuffer);
-    save_offset = 0;
+    if(saveg_open(name) == -1) {
+        return false;
+    }
 
     saveg_read_header();
 
@@ -1279,12 +1628,10 @@ dboolean P_QuickReadSaveHeader(char* name, char* date,
     int i;
     int size;
 
-    if(M_ReadFile(name, &savebuffer) == -1) {
+    if(saveg_open(name) == -1) {
         return 0;
     }
 
-    save_offset = 0;
-
     // skip the description field
     for(i = 0; i < SAVESTRINGSIZE; i++) {
         saveg_read8();
@@ -1314,6 +1661,384 @@ dboolean P_QuickReadSaveHeader(char* name, char* date,
 }
 
 
+//------------------------------------------------------------------------
+//
+// In-memory snapshots (p_rewind)
+//
+// Every p_rewindtics tics the world is serialized into memory, using
+// the same archive functions as savegames but without the description,
+// date and thumbnail. Only the newest snapshot is kept whole. Each older
+// one is kept as the XOR of itself and the snapshot after it, deflated,
+// which is mostly zeros and packs down to very little. Going back walks
+// the deltas from the newest, so the oldest entry can simply be dropped
+// when the ring is full.
+//
+//------------------------------------------------------------------------
+
+typedef struct {
+    byte*           delta;      // deflated XOR with the next newer snapshot
+    unsigned long   packedsize;
+    unsigned long   size;       // length of this snapshot's stream
+    int             map;
+    int             leveltime;
+} snapshot_t;
+
+static snapshot_t*      snapshots = NULL;
+static int              maxsnapshots = 0;
+static int              firstsnapshot = 0;
+static int              numsnapshots = 0;
+
+static byte*            snaplatest = NULL;  // the newest snapshot, whole
+static unsigned long    snaplatestsize = 0;
+
+static int              snaprestore = -1;   // entry to restore on the next load
+static double           snaplastms = 0;
+static dboolean         snapwarned = false;
+
+#define SNAPSHOT(i)     (&snapshots[(firstsnapshot + (i)) % maxsnapshots])
+
+//
+// saveg_write_ticstate
+// What a savegame leaves to chance but a rewind has to put
+// back for the game to run on the same as it did: the RNG
+// and how far into the level's tics it is, which P_Random
+// mixes in
+//
+
+static void saveg_write_ticstate(void) {
+    int i;
+
+    for(i = 0; i < NUMPRCLASS; i++) {
+        saveg_write32(rng.seed[i]);
+    }
+
+    saveg_write32(rng.rndindex);
+    saveg_write32(rng.prndindex);
+    saveg_write32(gametic - basetic);
+}
+
+//
+// saveg_read_ticstate
+//
+
+static void saveg_read_ticstate(rng_t* state, int* tics) {
+    int i;
+
+    for(i = 0; i < NUMPRCLASS; i++) {
+        state->seed[i] = saveg_read32();
+    }
+
+    state->rndindex = saveg_read32();
+    state->prndindex = saveg_read32();
+    *tics = saveg_read32();
+}
+
+//
+// P_ClearSnapshots
+//
+
+void P_ClearSnapshots(void) {
+    int i;
+
+    for(i = 0; i < numsnapshots; i++) {
+        free(SNAPSHOT(i)->delta);
+    }
+
+    free(snapshots);
+    free(snaplatest);
+
+    snapshots = NULL;
+    snaplatest = NULL;
+    snaplatestsize = 0;
+    maxsnapshots = 0;
+    firstsnapshot = 0;
+    numsnapshots = 0;
+    snaprestore = -1;
+}
+
+//
+// saveg_snapshotsallowed
+// Restoring changes the game under everyone else's
+// feet, so netgames and demos are left alone
+//
+
+static dboolean saveg_snapshotsallowed(void) {
+    return !netgame && !demoplayback && !demorecording;
+}
+
+//
+// saveg_xordelta
+// XORs b into a over len bytes, where each buffer
+// reads as zeros past its own length
+//
+
+static void saveg_xordelta(byte* out, byte* a, unsigned long alen,
+                           byte* b, unsigned long blen, unsigned long len) {
+    unsigned long i;
+
+    for(i = 0; i < len; i++) {
+        out[i] = (i < alen ? a[i] : 0) ^ (i < blen ? b[i] : 0);
+    }
+}
+
+//
+// P_CaptureSnapshot
+// Called at the end of every tic
+//
+
+void P_CaptureSnapshot(void) {
+    snapshot_t *snap;
+    uint64 start;
+    unsigned long len;
+    uLongf packedsize;
+    byte *delta;
+    int count;
+
+    if(!p_rewind.value || gamestate != GS_LEVEL || gameaction != ga_nothing ||
+            !saveg_snapshotsallowed()) {
+        return;
+    }
+
+    if(p_rewindtics.value < 1 || leveltime % (int)p_rewindtics.value) {
+        return;
+    }
+
+    start = SDL_GetPerformanceCounter();
+
+    // the ring is sized from the cvars, so start over if they changed
+    count = MAX((int)(p_rewindseconds.value * TICRATE / p_rewindtics.value), 2);
+
+    if(count != maxsnapshots) {
+        P_ClearSnapshots();
+        snapshots = calloc(count, sizeof(snapshot_t));
+        maxsnapshots = count;
+    }
+
+    save_maxsize = snaplatestsize ? snaplatestsize + (snaplatestsize >> 2) : SAVEGAMESIZE;
+    savebuffer = malloc(save_maxsize);
+    save_offset = 0;
+
+    if(savebuffer == NULL) {
+        I_Error("P_CaptureSnapshot: Out of memory for %lu bytes", save_maxsize);
+    }
+
+    saveg_write_gamestate();
+    saveg_write_ticstate();
+
+    P_WakeAll();
+
+    P_ArchiveMobjs();
+    P_ArchivePlayers();
+    P_ArchiveWorld();
+    P_ArchiveSpecials();
+    P_ArchiveMacros();
+
+    saveg_write_marker(SAVEGAME_EOF);
+
+    // turn the old newest snapshot into a delta against this one
+    if(numsnapshots) {
+        snap = SNAPSHOT(numsnapshots - 1);
+        len = MAX(snap->size, save_offset);
+        delta = malloc(len);
+        packedsize = compressBound(len);
+        snap->delta = malloc(packedsize);
+
+        saveg_xordelta(delta, snaplatest, snaplatestsize, savebuffer, save_offset, len);
+
+        if(compress2(snap->delta, &packedsize, delta, len, Z_BEST_SPEED) != Z_OK) {
+            I_Error("P_CaptureSnapshot: Couldn't pack snapshot");
+        }
+
+        snap->delta = realloc(snap->delta, packedsize);
+        snap->packedsize = packedsize;
+        free(delta);
+    }
+
+    free(snaplatest);
+    snaplatest = savebuffer;
+    snaplatestsize = save_offset;
+    savebuffer = NULL;
+    save_maxsize = 0;
+
+    if(numsnapshots == maxsnapshots) {
+        free(SNAPSHOT(0)->delta);
+        firstsnapshot = (firstsnapshot + 1) % maxsnapshots;
+        numsnapshots--;
+    }
+
+    snap = SNAPSHOT(numsnapshots++);
+    snap->delta = NULL;
+    snap->packedsize = 0;
+    snap->size = snaplatestsize;
+    snap->map = gamemap;
+    snap->leveltime = leveltime;
+
+    snaplastms = (double)(SDL_GetPerformanceCounter() - start) * 1000.0 /
+                 (double)SDL_GetPerformanceFrequency();
+
+    if(!snapwarned && snaplastms > p_rewindbudget.value) {
+        CON_Warnf("P_CaptureSnapshot: took %.2f ms, over the %.2f ms budget\n",
+                  snaplastms, p_rewindbudget.value);
+        snapwarned = true;
+    }
+}
+
+//
+// P_SnapshotPending
+//
+
+dboolean P_SnapshotPending(void) {
+    return snaprestore != -1;
+}
+
+//
+// P_RestoreSnapshot
+// Rebuilds the pending entry by walking back from the newest,
+// then loads it like a savegame. Anything newer is dropped
+//
+
+dboolean P_RestoreSnapshot(void) {
+    snapshot_t *snap;
+    byte *state;
+    byte *delta;
+    unsigned long size;
+    unsigned long len;
+    uLongf outlen;
+    rng_t savedrng;
+    int tics;
+    int index;
+    int i;
+
+    index = snaprestore;
+    snaprestore = -1;
+
+    if(index < 0 || index >= numsnapshots || !saveg_snapshotsallowed()) {
+        return false;
+    }
+
+    size = snaplatestsize;
+    state = malloc(size);
+    dmemcpy(state, snaplatest, size);
+
+    for(i = numsnapshots - 2; i >= index; i--) {
+        snap = SNAPSHOT(i);
+        len = MAX(snap->size, size);
+        outlen = len;
+        delta = malloc(len);
+
+        if(uncompress(delta, &outlen, snap->delta, snap->packedsize) != Z_OK || outlen != len) {
+            I_Error("P_RestoreSnapshot: Snapshot %i is damaged", i);
+        }
+
+        state = realloc(state, len);
+        saveg_xordelta(state, state, size, delta, len, len);
+        size = snap->size;
+
+        free(delta);
+    }
+
+    // the restored one becomes the newest
+    for(i = index + 1; i < numsnapshots; i++) {
+        free(SNAPSHOT(i)->delta);
+    }
+
+    snap = SNAPSHOT(index);
+    free(snap->delta);
+    snap->delta = NULL;
+    snap->packedsize = 0;
+    numsnapshots = index + 1;
+
+    free(snaplatest);
+    snaplatest = state;
+    snaplatestsize = size;
+
+    savebuffer = state;
+    save_offset = 0;
+
+    saveg_read_gamestate();
+    saveg_read_ticstate(&savedrng, &tics);
+
+    // load a base level
+    G_InitNew(gameskill, gamemap);
+    G_DoLoadLevel();
+
+    P_UnArchiveMobjs();
+    P_UnArchivePlayers();
+    P_UnArchiveWorld();
+    P_UnArchiveSpecials();
+    P_UnArchiveMacros();
+
+    if(!saveg_read_marker(SAVEGAME_EOF)) {
+        I_Error("P_RestoreSnapshot: Bad snapshot");
+    }
+
+    // both G_InitNew and P_SetupLevel reseed, and spawning the
+    // base level draws from it, so the RNG goes back last
+    rng = savedrng;
+    basetic = gametic - tics;
+
+    savebuffer = NULL;
+
+    return true;
+}
+
+//
+// CMD_Rewind
+// "rewind" lists the snapshots, "rewind n" goes back
+// n snapshots from the newest, restoring at the next load
+//
+
+static CMD(Rewind) {
+    snapshot_t *snap;
+    unsigned long packed;
+    int back;
+    int i;
+
+    if(!saveg_snapshotsallowed()) {
+        CON_Printf(WHITE, "rewind: not available in netgames or demos\n");
+        return;
+    }
+
+    if(!numsnapshots) {
+        CON_Printf(WHITE, "rewind: no snapshots, set p_rewind to 1 first\n");
+        return;
+    }
+
+    if(!param[0]) {
+        packed = snaplatestsize;
+
+        for(i = numsnapshots - 1; i >= 0; i--) {
+            snap = SNAPSHOT(i);
+            packed += snap->packedsize;
+
+            CON_Printf(WHITE, "%3i: map %02i %i:%02i\n", numsnapshots - 1 - i, snap->map,
+                       (snap->leveltime / TICRATE) / 60, (snap->leveltime / TICRATE) % 60);
+        }
+
+        CON_Printf(WHITE, "%i snapshots in %lu KB, last took %.2f ms\n",
+                   numsnapshots, packed >> 10, snaplastms);
+        return;
+    }
+
+    back = datoi(param[0]);
+
+    if(back < 0 || back >= numsnapshots) {
+        CON_Printf(WHITE, "rewind: pick 0 to %i\n", numsnapshots - 1);
+        return;
+    }
+
+    snaprestore = numsnapshots - 1 - back;
+    gameaction = ga_loadgame;
+}
+
+//
+// P_InitSnapshots
+//
+
+void P_InitSnapshots(void) {
+    G_AddCommand("rewind", CMD_Rewind, 0);
+}
+
 //
 // P_ArchivePlayers
 //
@@ -1470,6 +2195,11 @@ void P_UnArchiveWorld(void) {
         }
     }
 
+    // tags and flags came from the save
+    P_InitTagLists();
+    P_UpdateSectorEdges();
+    P_InitScrollingSectors();
+
     // do lights
     for(i = 0, light = lights; i < numlights; i++, light++) {
         light->base_r       = saveg_read8();
@@ -1533,6 +2263,7 @@ void P_UnArchiveMobjs(void) {
 
     saveg_setup_mobjread();
     mobjhead.next = mobjhead.prev = &mobjhead;
+    P_SchedClear(&mobjqueue);
 
     for(i = 0; i < savegmobjnum; i++) {
         mobj = savegmobj[i].mobj;
@@ -1806,6 +2537,7 @@ void P_UnArchiveSpecials(void) {
     }
 
     thinkercap.prev = thinkercap.next  = &thinkercap;
+    P_SchedClear(&thinkerqueue);
 
     while(1) {
         tclass = saveg_read8();
@@ -1821,7 +2553,7 @@ void P_UnArchiveSpecials(void) {
         for(i = 0; saveg_specials[i].type != tc_endthinkers; i++) {
             if(tclass == saveg_specials[i].type) {
                 saveg_read_pad();
-                thinker = Z_Malloc(saveg_specials[i].structsize, PU_LEVEL, NULL);
+                thinker = Z_Malloc(saveg_specials[i].structsize, PU_LEVSPEC, NULL);
                 saveg_specials[i].readfunc(thinker);
 
                 ((thinker_t*)thinker)->function.acp1 = (actionf_p1)saveg_specials[i].function.acp1;
@@ -37,6 +37,15 @@
 
 char *P_GetSaveGameName(int num);
 dboolean P_WriteSaveGame(char* description, int slot);
+dboolean P_WaitSaveGame(void);
+dboolean P_PollSaveGame(dboolean *ok);
+
+// in-memory snapshots, see p_rewind
+void P_InitSnapshots(void);
+void P_CaptureSnapshot(void);
+void P_ClearSnapshots(void);
+dboolean P_SnapshotPending(void);
+dboolean P_RestoreSnapshot(void);
 dboolean P_ReadSaveGame(char* name);
 dboolean P_QuickReadSaveHeader(char* name, char* date, int* thumbnail, int* skill, int* map);
 
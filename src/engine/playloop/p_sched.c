@@ -0,0 +1,451 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// Copyright(C) 2007-2012 Samuel Villarreal
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+//-----------------------------------------------------------------------------
+//
+// DESCRIPTION:
+//    Tic scheduler for mobjs and thinkers (p_scheduler).
+//
+//    Besides the mobj and thinker lists, each entry sits on a run list
+//    kept in the same order. P_RunMobjs and P_RunThinkers walk the run
+//    list instead, so anything that has nothing to do but wait is parked
+//    off it: mobjs resting on the floor in a state that only counts down
+//    its tics (or never ends), and light thinkers counting down to their
+//    next flash. Countdowns go into a timing wheel keyed by the pass they
+//    come due on, and their counter is only brought up to date when they
+//    wake, so nothing is called for them in between.
+//
+//    A woken entry is merged back into the run list as the walk passes its
+//    place, so everything still runs in list order and P_Random is drawn
+//    in the same sequence as before. Anything that changes a parked mobj
+//    from outside (damage, state changes, removal, moving it, sectors
+//    moving around it) wakes it first. p_schedverify checks every parked
+//    entry each tic and reports any that changed without being woken.
+//
+//-----------------------------------------------------------------------------
+
+#include "doomdef.h"
+#include "doomstat.h"
+#include "p_local.h"
+#include "p_spec.h"
+#include "con_console.h"
+
+CVAR_EXTERNAL(p_scheduler);
+CVAR_EXTERNAL(p_schedverify);
+
+enum {
+    SCHED_RUN,
+    SCHED_PENDING,
+    SCHED_DEFERRED,
+    SCHED_WHEEL,
+    SCHED_DORMANT
+};
+
+#define SCHED_WHEELMASK     (SCHED_WHEELSIZE - 1)
+
+schedqueue_t mobjqueue;
+schedqueue_t thinkerqueue;
+
+//
+// P_SchedInsert
+// Keeps the list sorted by link order. Nodes tend to
+// arrive in order, so the search starts from the tail
+//
+
+static void P_SchedInsert(schednode_t *list, schednode_t *node) {
+    schednode_t *pos;
+
+    for(pos = list->prev; pos != list && pos->seq > node->seq; pos = pos->prev);
+
+    node->prev = pos;
+    node->next = pos->next;
+    pos->next->prev = node;
+    pos->next = node;
+}
+
+//
+// P_SchedRemove
+//
+
+static void P_SchedRemove(schednode_t *node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+}
+
+//
+// P_SchedClear
+//
+
+void P_SchedClear(schedqueue_t *q) {
+    int i;
+
+    q->run.prev = q->run.next = &q->run;
+    q->pending.prev = q->pending.next = &q->pending;
+    q->deferred.prev = q->deferred.next = &q->deferred;
+
+    for(i = 0; i < SCHED_WHEELSIZE; i++) {
+        q->wheel[i].prev = q->wheel[i].next = &q->wheel[i];
+    }
+
+    q->cursor = &q->run;
+    q->curseq = -1;
+    q->pass = 0;
+    q->nextseq = 0;
+    q->numparked = 0;
+    q->running = false;
+}
+
+//
+// P_SchedLink
+// New entries always come last, so they go
+// straight onto the end of the run list
+//
+
+void P_SchedLink(schedqueue_t *q, schednode_t *node) {
+    node->seq = q->nextseq++;
+    node->where = SCHED_RUN;
+    node->counter = NULL;
+
+    node->next = &q->run;
+    node->prev = q->run.prev;
+    q->run.prev->next = node;
+    q->run.prev = node;
+}
+
+//
+// P_SchedUnlink
+//
+
+void P_SchedUnlink(schedqueue_t *q, schednode_t *node) {
+    if(node == q->cursor) {
+        q->cursor = node->prev;
+    }
+
+    if(node->where >= SCHED_WHEEL) {
+        q->numparked--;
+    }
+
+    if(node->where != SCHED_DORMANT) {
+        P_SchedRemove(node);
+    }
+}
+
+//
+// P_SchedPark
+// Only the node the walk is on can be parked. A
+// counter of one or less is due next pass anyway
+//
+
+static void P_SchedPark(schedqueue_t *q, schednode_t *node, int *counter, void *check) {
+    if(node != q->cursor || (counter && *counter < 2)) {
+        return;
+    }
+
+    q->cursor = node->prev;
+    P_SchedRemove(node);
+
+    node->parked = q->pass;
+    node->counter = counter;
+    node->check = check;
+    q->numparked++;
+
+    if(!counter) {
+        node->where = SCHED_DORMANT;
+        return;
+    }
+
+    // runs again on the pass its counter reaches zero, so it
+    // wakes at the end of the pass before with one tic left
+    node->count = *counter;
+    node->wake = q->pass + node->count - 1;
+    node->where = SCHED_WHEEL;
+
+    P_SchedInsert(&q->wheel[node->wake & SCHED_WHEELMASK], node);
+}
+
+//
+// P_SchedWake
+// Catches the counter up on the passes that skipped
+// it. If the current pass has not reached it yet, it
+// is still owed that pass and is merged in this pass
+//
+
+static void P_SchedWake(schedqueue_t *q, schednode_t *node) {
+    int elapsed;
+
+    if(node->where < SCHED_WHEEL) {
+        return;
+    }
+
+    if(node->where == SCHED_WHEEL) {
+        elapsed = q->pass - node->parked;
+
+        if(q->running && node->seq > q->curseq) {
+            elapsed--;
+        }
+
+        *node->counter = node->count - elapsed;
+        P_SchedRemove(node);
+    }
+
+    node->counter = NULL;
+    q->numparked--;
+
+    if(q->running && node->seq < q->curseq) {
+        node->where = SCHED_DEFERRED;
+        P_SchedInsert(&q->deferred, node);
+    }
+    else {
+        node->where = SCHED_PENDING;
+        P_SchedInsert(&q->pending, node);
+    }
+}
+
+//
+// P_SchedBeginPass
+//
+
+void P_SchedBeginPass(schedqueue_t *q) {
+    schednode_t *node;
+
+    while((node = q->deferred.next) != &q->deferred) {
+        P_SchedRemove(node);
+        node->where = SCHED_PENDING;
+        P_SchedInsert(&q->pending, node);
+    }
+
+    q->pass++;
+    q->cursor = &q->run;
+    q->curseq = -1;
+    q->running = true;
+}
+
+//
+// P_SchedNext
+// Steps the walk on, splicing in any woken node
+// that comes before the next one on the run list
+//
+
+schednode_t *P_SchedNext(schedqueue_t *q) {
+    schednode_t *next;
+    schednode_t *node;
+
+    next = q->cursor->next;
+    node = q->pending.next;
+
+    if(node != &q->pending && (next == &q->run || node->seq < next->seq)) {
+        P_SchedRemove(node);
+
+        node->where = SCHED_RUN;
+        node->prev = q->cursor;
+        node->next = next;
+        next->prev = node;
+        q->cursor->next = node;
+
+        next = node;
+    }
+
+    if(next == &q->run) {
+        return NULL;
+    }
+
+    q->cursor = next;
+    q->curseq = next->seq;
+
+    return next;
+}
+
+//
+// P_SchedEndPass
+// Wakes everything due on the next pass. A wheel slot
+// also holds nodes a full turn or more further off
+//
+
+void P_SchedEndPass(schedqueue_t *q) {
+    schednode_t *slot;
+    schednode_t *node;
+    schednode_t *next;
+
+    q->running = false;
+
+    slot = &q->wheel[q->pass & SCHED_WHEELMASK];
+
+    for(node = slot->next; node != slot; node = next) {
+        next = node->next;
+
+        if(node->wake == q->pass) {
+            P_SchedWake(q, node);
+        }
+    }
+}
+
+//
+// P_SchedEnabled
+// Locked monsters don't count down at all and nightmare
+// respawns can happen at any time, so both run unscheduled
+//
+
+dboolean P_SchedEnabled(void) {
+    if(!p_scheduler.value) {
+        return false;
+    }
+
+    if(gameflags & GF_LOCKMONSTERS || respawnmonsters) {
+        return false;
+    }
+
+    return true;
+}
+
+//
+// P_MobjIdle
+// True when P_MobjThinker would do nothing but
+// count down the mobj's tics
+//
+
+static dboolean P_MobjIdle(mobj_t *mobj) {
+    if(mobj->player || mobj->mobjfunc || !mobj->state) {
+        return false;
+    }
+
+    if(mobj->flags & MF_NOSECTOR) {
+        return false;
+    }
+
+    if(mobj->momx || mobj->momy || mobj->momz || mobj->z != mobj->floorz) {
+        return false;
+    }
+
+    return true;
+}
+
+//
+// P_SchedParkMobj
+//
+
+void P_SchedParkMobj(mobj_t *mobj) {
+    if(!P_MobjIdle(mobj)) {
+        return;
+    }
+
+    P_SchedPark(&mobjqueue, &mobj->sched, mobj->tics == -1 ? NULL : &mobj->tics, mobj->state);
+}
+
+//
+// P_SchedParkThinker
+//
+
+void P_SchedParkThinker(thinker_t *thinker) {
+    int *counter;
+
+    if(!(counter = P_LightCountdown(thinker))) {
+        return;
+    }
+
+    P_SchedPark(&thinkerqueue, &thinker->sched, counter, (void*)thinker->function.acp1);
+}
+
+//
+// P_WakeMobj
+//
+
+void P_WakeMobj(mobj_t *mobj) {
+    if(mobj->sched.where >= SCHED_WHEEL) {
+        P_SchedWake(&mobjqueue, &mobj->sched);
+    }
+}
+
+//
+// P_WakeThinker
+//
+
+void P_WakeThinker(thinker_t *thinker) {
+    if(thinker->sched.where >= SCHED_WHEEL) {
+        P_SchedWake(&thinkerqueue, &thinker->sched);
+    }
+}
+
+//
+// P_WakeAll
+// Brings every counter up to date, for savegames
+// and for when the scheduler is switched off
+//
+
+void P_WakeAll(void) {
+    mobj_t *mobj;
+    thinker_t *thinker;
+
+    if(mobjqueue.numparked) {
+        for(mobj = mobjhead.next; mobj != &mobjhead; mobj = mobj->next) {
+            P_WakeMobj(mobj);
+        }
+    }
+
+    if(thinkerqueue.numparked) {
+        for(thinker = thinkercap.next; thinker != &thinkercap; thinker = thinker->next) {
+            P_WakeThinker(thinker);
+        }
+    }
+}
+
+//
+// P_SchedVerify
+// Parked entries should look exactly as they did when
+// they were parked. Anything that doesn't was changed
+// without being woken and would have gone out of sync
+//
+
+void P_SchedVerify(void) {
+    mobj_t *mobj;
+    thinker_t *thinker;
+    schednode_t *node;
+
+    if(!p_schedverify.value) {
+        return;
+    }
+
+    for(mobj = mobjhead.next; mobj != &mobjhead; mobj = mobj->next) {
+        node = &mobj->sched;
+
+        if(node->where < SCHED_WHEEL) {
+            continue;
+        }
+
+        if(!P_MobjIdle(mobj) || mobj->state != node->check ||
+                (node->counter && *node->counter != node->count)) {
+            CON_Warnf("P_SchedVerify: mobj %i (type %i) changed while parked\n",
+                      node->seq, mobj->type);
+            P_SchedWake(&mobjqueue, node);
+        }
+    }
+
+    for(thinker = thinkercap.next; thinker != &thinkercap; thinker = thinker->next) {
+        node = &thinker->sched;
+
+        if(node->where < SCHED_WHEEL) {
+            continue;
+        }
+
+        if((void*)thinker->function.acp1 != node->check || *node->counter != node->count) {
+            CON_Warnf("P_SchedVerify: thinker %i changed while parked\n", node->seq);
+            P_SchedWake(&thinkerqueue, node);
+        }
+    }
+}
@@ -36,11 +36,13 @@
 #include "g_game.h"
 #include "i_system.h"
 #include "w_wad.h"
+#include "w_prefetch.h"
 #include "p_local.h"
 #include "s_sound.h"
 #include "doomstat.h"
 #include "t_bsp.h"
 #include "p_macros.h"
+#include "p_saveg.h"
 #include "info.h"
 #include "m_misc.h"
 #include "tables.h"
@@ -98,6 +100,18 @@ CVAR(p_sdoubleclick, 0);
 CVAR(p_usecontext, 0);
 CVAR(p_damageindicator, 0);
 CVAR(p_regionmode, 0);
+CVAR(p_sightthreads, 0);    // 0 picks from the number of CPUs, 1 keeps it serial
+CVAR(p_sightcache, 1);      // 0 traces every sight check, for comparing demos
+CVAR(p_autoreject, 1);      // build REJECT for maps that ship it empty
+CVAR(p_scheduler, 0);       // park idle mobjs and light thinkers until due
+CVAR(p_schedverify, 0);     // check parked entries each tic
+CVAR(p_blockmap, 0);        // 1 always builds the blockmap instead of loading it
+CVAR(p_blocksize, 128);     // block size in map units for built blockmaps
+CVAR(p_savecompress, 1);    // deflate savegames, 0 writes the old uncompressed layout
+CVAR(p_rewind, 0);          // keep in-memory snapshots for the rewind command
+CVAR(p_rewindseconds, 30);  // how far back the snapshots reach
+CVAR(p_rewindtics, 35);     // tics between snapshots
+CVAR(p_rewindbudget, 2);    // warn when a snapshot takes longer, in ms
 
 //
 // [kex] sky definition stuff
@@ -116,12 +130,14 @@ static skydef_t*    skydefs;
 // Blockmap size.
 int                 bmapwidth;
 int                 bmapheight;     // size in mapblocks
-short*              blockmap;       // int for larger maps
+int*                blockmap;       // int for larger maps
 // offsets in blockmap are from here
-short*              blockmaplump;
+int*                blockmaplump;
 // origin of block map
 fixed_t             bmaporgx;
 fixed_t             bmaporgy;
+// block size, 7 for the shipped 128 unit blocks
+int                 bmapshift = 7;
 // for thing chains
 mobj_t**            blocklinks;
 
@@ -745,12 +761,35 @@ void P_LoadSideDefs(int lump) {
 //
 
 void P_LoadReject(int lump) {
-    int size = 0;
+    int size;
+    int lumpsize;
+    byte *data;
+    int i;
+
+    // a short lump is padded out rather than read past
+    size = ((numsectors * numsectors) + 7) >> 3;
+    lumpsize = W_MapLumpLength(lump);
 
-    size = W_MapLumpLength(lump);
     rejectmatrix = (byte*)Z_Malloc(size, PU_LEVEL, 0);
     dmemset(rejectmatrix, 0, size);
-    dmemcpy(rejectmatrix, (byte*)W_GetMapLump(lump), size);
+    dmemcpy(rejectmatrix, (byte*)W_GetMapLump(lump), MIN(size, lumpsize));
+
+    if(!p_autoreject.value) {
+        return;
+    }
+
+    if(lumpsize >= size) {
+        data = rejectmatrix;
+
+        for(i = 0; i < size; i++) {
+            if(data[i]) {
+                return;
+            }
+        }
+    }
+
+    // missing or all zero, so every check would go through the BSP
+    P_BuildReject(rejectmatrix, size);
 }
 
 static const char *bmaperrormsg;
@@ -763,15 +802,15 @@ static const char *bmaperrormsg;
 static dboolean P_VerifyBlockMap(int count) {
     dboolean isvalid = true;
     int x, y;
-    short *maxoffs = blockmaplump + count;
+    int *maxoffs = blockmaplump + count;
 
     bmaperrormsg = NULL;
 
     for(y = 0; y < bmapheight; ++y) {
         for(x = 0; x < bmapwidth; ++x) {
             int offset;
-            short *list, *tmplist;
-            short *blockoffset;
+            int *list, *tmplist;
+            int *blockoffset;
 
             offset = y * bmapwidth + x;
             blockoffset = blockmaplump + offset + 4;
@@ -784,6 +823,14 @@ static dboolean P_VerifyBlockMap(int count) {
             }
 
             offset = *blockoffset;
+
+            // a block can't start in the header or past the lump
+            if(offset < 0 || offset >= count) {
+                isvalid = false;
+                bmaperrormsg = "list offset out of range";
+                break;
+            }
+
             list   = blockmaplump + offset;
 
             // scan forward for a -1 terminator before maxoffs
@@ -825,40 +872,75 @@ static dboolean P_VerifyBlockMap(int count) {
 }
 
 
+//
+// P_BlockMapSize
+// Block size for built blockmaps, rounded
+// down to a power of two
+//
+
+static int P_BlockMapSize(void) {
+    int size = (int)p_blocksize.value;
+    int blocksize;
+
+    size = MAX(MIN(size, 1024), 32);
+
+    for(blocksize = 32; (blocksize << 1) <= size; blocksize <<= 1);
+
+    return blocksize;
+}
+
 //
 // P_LoadBlockMap
 //
+// Offsets are widened to 32 bits on load. Entries are read
+// as unsigned so lists past 32K still work, and a blockmap
+// that is missing, too big to address or fails verification
+// is built from the lines instead
+//
 
 void P_LoadBlockMap(int lump) {
     int         i;
     int         count;
-    void*       mapdata;
+    short*      mapdata;
     size_t      len;
 
-    mapdata = W_GetMapLump(lump);
     len = W_MapLumpLength(lump);
-
-    //
-    // GhostlyDeath <10/3/11> -- Reallocate and copy since
-    // W_GetMapLump() doesn't quite work like we want it to on 64-bit
-    // it works, just the way it is laid out
-    //
-    blockmaplump = Z_Malloc(len, PU_LEVEL, NULL);
-    memmove(blockmaplump, mapdata, len);
-    blockmap = blockmaplump + 4;
     count = len / 2;
 
-    for(i = 0; i < count; i++) {
-        blockmaplump[i] = SHORT(blockmaplump[i]);
+    bmapshift = 7;
+
+    if(p_blockmap.value || count < 4 || count > 0x10000) {
+        P_CreateBlockMap(P_BlockMapSize());
     }
+    else {
+        mapdata = W_GetMapLump(lump);
 
-    bmaporgx = INT2F(blockmaplump[0]);
-    bmaporgy = INT2F(blockmaplump[1]);
-    bmapwidth = blockmaplump[2];
-    bmapheight = blockmaplump[3];
+        //
+        // GhostlyDeath <10/3/11> -- Reallocate and copy since
+        // W_GetMapLump() doesn't quite work like we want it to on 64-bit
+        // it works, just the way it is laid out
+        //
+        blockmaplump = Z_Malloc(count * sizeof(int), PU_LEVEL, NULL);
+        blockmap = blockmaplump + 4;
 
-    if(!P_VerifyBlockMap(count)) {
-        I_Error("P_LoadBlockMap: Bad blockmap - %s", bmaperrormsg);
+        blockmaplump[0] = SHORT(mapdata[0]);
+        blockmaplump[1] = SHORT(mapdata[1]);
+
+        for(i = 2; i < count; i++) {
+            short t = SHORT(mapdata[i]);
+            blockmaplump[i] = (t == -1 && i >= 4) ? -1 : (int)(word)t;
+        }
+
+        bmaporgx = INT2F(blockmaplump[0]);
+        bmaporgy = INT2F(blockmaplump[1]);
+        bmapwidth = blockmaplump[2];
+        bmapheight = blockmaplump[3];
+
+        if(!P_VerifyBlockMap(count)) {
+            CON_Warnf("P_LoadBlockMap: Bad blockmap - %s, rebuilding\n", bmaperrormsg);
+            Z_Free(blockmaplump);
+            P_CreateBlockMap(P_BlockMapSize());
+        }
     }
 
     // clear out mobj chains
@@ -877,6 +959,8 @@ void P_LoadBlockMap(int lump) {
 
 void P_GroupLines(void) {
     line_t**            linebuffer;
+    sectoredge_t*       edgebuffer;
+    int                 edges;
     int                 i;
     int                 j;
     int                 total;
@@ -916,23 +1000,67 @@ void P_GroupLines(void) {
         }
     }
 
-    // build line tables for each sector
+    // build line tables for each sector. Lines are dealt out
+    // in index order, so every table stays sorted
     linebuffer =  Z_Malloc(total * sizeof(*linebuffer), PU_LEVEL, 0);
     sector = sectors;
     for(i=0 ; i<numsectors ; i++, sector++) {
-        M_ClearBox(bbox);
         sector->lines = linebuffer;
-        li = lines;
-        for(j=0 ; j<numlines ; j++, li++) {
-            if(li->frontsector == sector || li->backsector == sector) {
-                *linebuffer++ = li;
-                M_AddToBox(bbox, li->v1->x, li->v1->y);
-                M_AddToBox(bbox, li->v2->x, li->v2->y);
+        linebuffer += sector->linecount;
+        sector->linecount = 0;
+        sector->edgecount = 0;
+    }
+
+    li = lines;
+    edges = 0;
+    for(i=0 ; i<numlines ; i++, li++) {
+        li->frontsector->lines[li->frontsector->linecount++] = li;
+
+        if(li->backsector) {
+            li->frontsector->edgecount++;
+
+            if(li->backsector != li->frontsector) {
+                li->backsector->lines[li->backsector->linecount++] = li;
+                li->backsector->edgecount++;
             }
+
+            edges += (li->backsector != li->frontsector) ? 2 : 1;
         }
-        if(linebuffer - sector->lines != sector->linecount) {
+    }
+
+    // adjacency graph, one edge per line with a sector behind it
+    edgebuffer = Z_Malloc(MAX(edges, 1) * sizeof(*edgebuffer), PU_LEVEL, 0);
+    sector = sectors;
+    for(i=0 ; i<numsectors ; i++, sector++) {
+        sector->edges = edgebuffer;
+
+        for(j=0 ; j<sector->linecount ; j++) {
+            li = sector->lines[j];
+
+            if(!li->backsector) {
+                continue;
+            }
+
+            edgebuffer->line = li;
+            edgebuffer->other = (li->frontsector == sector) ? li->backsector : li->frontsector;
+            edgebuffer++;
+        }
+
+        if(edgebuffer - sector->edges != sector->edgecount) {
             I_Error("P_GroupLines: miscounted");
         }
+    }
+
+    P_UpdateSectorEdges();
+
+    sector = sectors;
+    for(i=0 ; i<numsectors ; i++, sector++) {
+        M_ClearBox(bbox);
+        for(j=0 ; j<sector->linecount ; j++) {
+            li = sector->lines[j];
+            M_AddToBox(bbox, li->v1->x, li->v1->y);
+            M_AddToBox(bbox, li->v2->x, li->v2->y);
+        }
 
         // set the degenmobj_t to the middle of the bounding box
         sector->soundorg.x = (bbox[BOXRIGHT]+bbox[BOXLEFT])/2;
@@ -1070,8 +1198,10 @@ void P_SetupLevel(int map, int playermask, skill_t skill) {
     P_LoadSegs(ML_SEGS);
     P_LoadLeafs(ML_LEAFS);
     P_LoadReject(ML_REJECT);
+    P_ResetSightCache();
     P_LoadLights(ML_LIGHTS);
     P_GroupLines();
+    P_InitTagLists();
     P_LoadThings(ML_THINGS);
     W_FreeMapLump();
 
@@ -1106,6 +1236,9 @@ void P_SetupLevel(int map, int playermask, skill_t skill) {
     R_PrecacheLevel();
     R_SetupLevel();
 
+    // anything still staged for this map wasn't needed
+    W_ReleasePrefetch();
+
     Z_CheckHeap();
 
     CON_DPrintf("Used memory: %d kb\n", Z_FreeMemory() >> 10);
@@ -1470,6 +1603,8 @@ void P_Init(void) {
     R_InitSprites(sprnames);
     P_InitMapInfo();
     P_InitSkyDef();
+    P_InitTraceBench();
+    P_InitSnapshots();
 }
 
 //
@@ -1484,5 +1619,17 @@ void P_RegisterCvars(void) {
     CON_CvarRegister(&p_usecontext);
     CON_CvarRegister(&p_damageindicator);
     CON_CvarRegister(&p_regionmode);
+    CON_CvarRegister(&p_sightthreads);
+    CON_CvarRegister(&p_sightcache);
+    CON_CvarRegister(&p_autoreject);
+    CON_CvarRegister(&p_scheduler);
+    CON_CvarRegister(&p_schedverify);
+    CON_CvarRegister(&p_blockmap);
+    CON_CvarRegister(&p_blocksize);
+    CON_CvarRegister(&p_savecompress);
+    CON_CvarRegister(&p_rewind);
+    CON_CvarRegister(&p_rewindseconds);
+    CON_CvarRegister(&p_rewindtics);
+    CON_CvarRegister(&p_rewindbudget);
 }
 
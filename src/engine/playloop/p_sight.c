@@ -25,27 +25,113 @@
 // DESCRIPTION:
 //    LineOfSight/Visibility checks, uses REJECT Lookup Table.
 //
+//    All traversal state lives in a sightctx_t, and lines already
+//    crossed are marked in the context's own bitset rather than with
+//    validcount, so any number of checks can run at once. P_ScanSights
+//    spreads the monsters' checks over a pool of worker threads and
+//    applies the results afterwards in mobj order.
+//
+//    Results are kept in a small set-associative cache, hashed on the
+//    two subsectors and a quantized eye and target z. An entry stores
+//    the exact endpoints and the sectors whose heights the trace read,
+//    and only counts as a hit while none of those sectors has moved
+//    since, so a hit always equals a fresh check.
+//
 //-----------------------------------------------------------------------------
 
+#include "SDL.h"
+
 #include "doomdef.h"
 #include "m_fixed.h"
 #include "i_system.h"
 #include "p_local.h"
 #include "doomstat.h"
+#include "con_cvar.h"
+
+#define MAXSIGHTTHREADS     8
+#define SIGHTBATCH          16      // jobs taken by a thread at a time
+#define SIGHTMINPARALLEL    64      // fewer jobs than this run serially
+
+#define SIGHTCACHESETS      512
+#define SIGHTCACHEWAYS      4
+#define SIGHTCACHESECTORS   12      // traces reading more sectors aren't cached
 
 //
 // P_CheckSight
 //
-fixed_t     sightzstart;        // eye z of looker
-fixed_t     topslope;
-fixed_t     bottomslope;        // slopes to top and bottom of target
 
-divline_t   strace;             // from t1 to t2
-fixed_t     t2x;
-fixed_t     t2y;
+typedef struct {
+    fixed_t     sightzstart;        // eye z of looker
+    fixed_t     topslope;
+    fixed_t     bottomslope;        // slopes to top and bottom of target
+    divline_t   strace;             // from t1 to t2
+    fixed_t     t2x;
+    fixed_t     t2y;
+    byte*       visited;            // one bit per line, all clear between checks
+    int*        touched;            // lines marked in visited by this check
+    int         numtouched;
+    int         maxlines;
+    int         sightcounts[2];
+    int         numcachesectors;    // SIGHTCACHESECTORS+1 once it overflows
+    int         cachesectors[SIGHTCACHESECTORS];
+} sightctx_t;
+
+typedef struct {
+    fixed_t     x1;
+    fixed_t     y1;
+    fixed_t     z1;                 // eye z of looker
+    fixed_t     x2;
+    fixed_t     y2;
+    fixed_t     bottom;
+    fixed_t     top;                // z range of target
+} sightkey_t;
+
+typedef struct {
+    sightkey_t  key;
+    unsigned int stamp;             // sightclock when traced, 0 if empty
+    int         lastused;
+    int         numsectors;
+    int         sectors[SIGHTCACHESECTORS];
+    dboolean    result;
+} sightcache_t;
+
+typedef struct {
+    mobj_t*     mobj;
+    dboolean    result;
+    dboolean    done;               // answered before the parallel run
+    sightkey_t  key;
+    int         set;
+    int         numsectors;
+    int         sectors[SIGHTCACHESECTORS];
+} sightjob_t;
 
 int         sightcounts[2];
 
+CVAR_EXTERNAL(p_sightthreads);
+CVAR_EXTERNAL(p_sightcache);
+
+// context 0 belongs to the main thread
+static sightctx_t   sightctx[MAXSIGHTTHREADS];
+
+static SDL_Thread*  sightthreads[MAXSIGHTTHREADS];
+static int          numsightthreads = -1;   // workers, not counting the main thread
+static int          activesightthreads = 0;
+static SDL_mutex*   sightlock = NULL;
+static SDL_cond*    sightstartcond = NULL;
+static SDL_cond*    sightdonecond = NULL;
+static int          sightgeneration = 0;
+static int          sightpending = 0;
+
+static sightjob_t*  sightjobs = NULL;
+static int          numsightjobs = 0;
+static int          maxsightjobs = 0;
+static SDL_atomic_t nextsightjob;
+
+static sightcache_t     sightcache[SIGHTCACHESETS * SIGHTCACHEWAYS];
+static unsigned int*    sightsectorstamp = NULL;    // sightclock of last height change
+static unsigned int     sightclock = 1;
+static int              sightcachehits = 0;
+static int              sightcachemisses = 0;
 
 //
 // P_DivlineSide
@@ -126,17 +212,44 @@ fixed_t P_InterceptVector2(divline_t* v2, divline_t* v1) {
     return frac;
 }
 
+//
+// P_SightReadSector
+// Notes a sector whose heights the trace depends on
+//
+
+static void P_SightReadSector(sightctx_t *ctx, sector_t *sec) {
+    int num = sec - sectors;
+    int i;
+
+    if(ctx->numcachesectors > SIGHTCACHESECTORS) {
+        return;
+    }
+
+    for(i = 0; i < ctx->numcachesectors; i++) {
+        if(ctx->cachesectors[i] == num) {
+            return;
+        }
+    }
+
+    if(ctx->numcachesectors < SIGHTCACHESECTORS) {
+        ctx->cachesectors[ctx->numcachesectors] = num;
+    }
+
+    ctx->numcachesectors++;
+}
+
 //
 // P_CrossSubsector
 // Returns true if strace crosses the given subsector successfully.
 //
 
-dboolean P_CrossSubsector(int num) {
+static dboolean P_CrossSubsector(sightctx_t *ctx, int num) {
     seg_t*          seg;
     line_t*         line;
     int             s1;
     int             s2;
     int             count;
+    int             linenum;
     subsector_t*    sub;
     sector_t*       front;
     sector_t*       back;
@@ -168,16 +281,19 @@ dboolean P_CrossSubsector(int num) {
         }
 
         // allready checked other side?
-        if(line->validcount == validcount) {
+        linenum = line - lines;
+
+        if(ctx->visited[linenum >> 3] & (1 << (linenum & 7))) {
             continue;
         }
 
-        line->validcount = validcount;
+        ctx->visited[linenum >> 3] |= (1 << (linenum & 7));
+        ctx->touched[ctx->numtouched++] = linenum;
 
         v1 = line->v1;
         v2 = line->v2;
-        s1 = P_DivlineSide(v1->x,v1->y, &strace);
-        s2 = P_DivlineSide(v2->x, v2->y, &strace);
+        s1 = P_DivlineSide(v1->x,v1->y, &ctx->strace);
+        s2 = P_DivlineSide(v2->x, v2->y, &ctx->strace);
 
         // line isn't crossed?
         if(s1 == s2) {
@@ -188,8 +304,8 @@ dboolean P_CrossSubsector(int num) {
         divl.y = v1->y;
         divl.dx = v2->x - v1->x;
         divl.dy = v2->y - v1->y;
-        s1 = P_DivlineSide(strace.x, strace.y, &divl);
-        s2 = P_DivlineSide(t2x, t2y, &divl);
+        s1 = P_DivlineSide(ctx->strace.x, ctx->strace.y, &divl);
+        s2 = P_DivlineSide(ctx->t2x, ctx->t2y, &divl);
 
         // line isn't crossed?
         if(s1 == s2) {
@@ -206,6 +322,9 @@ dboolean P_CrossSubsector(int num) {
         front = seg->frontsector;
         back = seg->backsector;
 
+        P_SightReadSector(ctx, front);
+        P_SightReadSector(ctx, back);
+
         // no wall to block sight with?
         if(front->floorheight == back->floorheight
                 && front->ceilingheight == back->ceilingheight) {
@@ -234,23 +353,23 @@ dboolean P_CrossSubsector(int num) {
             return false;    // stop
         }
 
-        frac = P_InterceptVector2(&strace, &divl);
+        frac = P_InterceptVector2(&ctx->strace, &divl);
 
         if(front->floorheight != back->floorheight) {
-            slope = FixedDiv(openbottom - sightzstart , frac);
-            if(slope > bottomslope) {
-                bottomslope = slope;
+            slope = FixedDiv(openbottom - ctx->sightzstart , frac);
+            if(slope > ctx->bottomslope) {
+                ctx->bottomslope = slope;
             }
         }
 
         if(front->ceilingheight != back->ceilingheight) {
-            slope = FixedDiv(opentop - sightzstart , frac);
-            if(slope < topslope) {
-                topslope = slope;
+            slope = FixedDiv(opentop - ctx->sightzstart , frac);
+            if(slope < ctx->topslope) {
+                ctx->topslope = slope;
             }
         }
 
-        if(topslope <= bottomslope) {
+        if(ctx->topslope <= ctx->bottomslope) {
             return false;    // stop
         }
     }
@@ -266,58 +385,77 @@ dboolean P_CrossSubsector(int num) {
 // Returns true if strace crosses the given node successfully.
 //
 
-dboolean P_CrossBSPNode(int bspnum) {
+static dboolean P_CrossBSPNode(sightctx_t *ctx, int bspnum) {
     node_t* bsp;
     int     side;
 
     if(bspnum & NF_SUBSECTOR) {
         if(bspnum == -1) {
-            return P_CrossSubsector(0);
+            return P_CrossSubsector(ctx, 0);
         }
         else {
-            return P_CrossSubsector(bspnum&(~NF_SUBSECTOR));
+            return P_CrossSubsector(ctx, bspnum&(~NF_SUBSECTOR));
         }
     }
 
     bsp = &nodes[bspnum];
 
     // decide which side the start point is on
-    side = P_DivlineSide(strace.x, strace.y, (divline_t *)bsp);
+    side = P_DivlineSide(ctx->strace.x, ctx->strace.y, (divline_t *)bsp);
     if(side == 2) {
         side = 0;    // an "on" should cross both sides
     }
 
     // cross the starting side
-    if(!P_CrossBSPNode(bsp->children[side])) {
+    if(!P_CrossBSPNode(ctx, bsp->children[side])) {
         return false;
     }
 
     // the partition plane is crossed here
-    if(side == P_DivlineSide(t2x, t2y,(divline_t *)bsp)) {
+    if(side == P_DivlineSide(ctx->t2x, ctx->t2y,(divline_t *)bsp)) {
         // the line doesn't touch the other side
         return true;
     }
 
     // cross the ending side
-    return P_CrossBSPNode(bsp->children[side^1]);
+    return P_CrossBSPNode(ctx, bsp->children[side^1]);
 }
 
 
 //
-// P_CheckSight
-// Returns true if a straight line between t1 and t2 is unobstructed.
-// Uses REJECT.
+// P_SetupSightContext
+// Main thread only. Line marks need a bit for every line of the map
 //
 
-dboolean P_CheckSight(mobj_t* t1, mobj_t* t2) {
+static void P_SetupSightContext(sightctx_t *ctx) {
+    if(ctx->maxlines >= numlines) {
+        return;
+    }
+
+    free(ctx->visited);
+    free(ctx->touched);
+
+    ctx->maxlines = numlines;
+    ctx->visited = calloc((numlines + 7) >> 3, 1);
+    ctx->touched = malloc(numlines * sizeof(int));
+
+    if(ctx->visited == NULL || ctx->touched == NULL) {
+        I_Error("P_SetupSightContext: Couldn't allocate %i lines", numlines);
+    }
+}
+
+//
+// P_SightRejected
+// Trivial rejection through the REJECT table
+//
+
+static dboolean P_SightRejected(sightctx_t *ctx, mobj_t* t1, mobj_t* t2) {
     int     s1;
     int     s2;
     int     pnum;
     int     bytenum;
     int     bitnum;
 
-    // First check for trivial rejection.
-
     // Determine subsector entries in REJECT table.
     s1 = (t1->subsector->sector - sectors);
     s2 = (t2->subsector->sector - sectors);
@@ -327,31 +465,397 @@ dboolean P_CheckSight(mobj_t* t1, mobj_t* t2) {
 
     // Check in REJECT table.
     if(rejectmatrix[bytenum]&bitnum) {
-        sightcounts[0]++;
+        ctx->sightcounts[0]++;
 
         // can't possibly be connected
-        return false;
+        return true;
     }
 
     // An unobstructed LOS is possible.
-    // Now look from eyes of t1 to any part of t2.
-    sightcounts[1]++;
+    ctx->sightcounts[1]++;
 
-    D_IncValidCount();
+    return false;
+}
+
+//
+// P_TraceSight
+// Looks from the eyes of t1 to any part of t2
+//
 
-    sightzstart = t1->z + t1->height - (t1->height>>2);
-    topslope = (t2->z+t2->height) - sightzstart;
-    bottomslope = (t2->z) - sightzstart;
+static dboolean P_TraceSight(sightctx_t *ctx, sightkey_t *key) {
+    int     i;
+    dboolean result;
 
-    strace.x = t1->x;
-    strace.y = t1->y;
-    t2x = t2->x;
-    t2y = t2->y;
-    strace.dx = t2->x - t1->x;
-    strace.dy = t2->y - t1->y;
+    ctx->numcachesectors = 0;
+
+    ctx->sightzstart = key->z1;
+    ctx->topslope = key->top - ctx->sightzstart;
+    ctx->bottomslope = key->bottom - ctx->sightzstart;
+
+    ctx->strace.x = key->x1;
+    ctx->strace.y = key->y1;
+    ctx->t2x = key->x2;
+    ctx->t2y = key->y2;
+    ctx->strace.dx = key->x2 - key->x1;
+    ctx->strace.dy = key->y2 - key->y1;
 
     // the head node is the last node output
-    return P_CrossBSPNode(numnodes-1);
+    result = P_CrossBSPNode(ctx, numnodes-1);
+
+    // leave the bitset clear for the next check
+    for(i = 0; i < ctx->numtouched; i++) {
+        ctx->visited[ctx->touched[i] >> 3] = 0;
+    }
+
+    ctx->numtouched = 0;
+
+    return result;
+}
+
+//
+// P_SightCacheKey
+// Fills in the exact inputs of the trace and
+// returns the cache set they belong to
+//
+
+static int P_SightCacheKey(mobj_t* t1, mobj_t* t2, sightkey_t *key) {
+    unsigned int hash;
+
+    key->x1 = t1->x;
+    key->y1 = t1->y;
+    key->z1 = t1->z + t1->height - (t1->height>>2);
+    key->x2 = t2->x;
+    key->y2 = t2->y;
+    key->bottom = t2->z;
+    key->top = t2->z + t2->height;
+
+    // subsector pair and z in 32 unit steps
+    hash = (unsigned int)(t1->subsector - subsectors) * 0x9E3779B1u;
+    hash ^= (unsigned int)(t2->subsector - subsectors) * 0x85EBCA6Bu;
+    hash ^= (unsigned int)(key->z1 >> (FRACBITS + 5)) * 0xC2B2AE35u;
+    hash ^= (unsigned int)(key->bottom >> (FRACBITS + 5)) * 0x27D4EB2Fu;
+
+    return (hash ^ (hash >> 15)) & (SIGHTCACHESETS - 1);
+}
+
+//
+// P_SightKeyMatch
+//
+
+static dboolean P_SightKeyMatch(sightkey_t *a, sightkey_t *b) {
+    return (a->x1 == b->x1 && a->y1 == b->y1 && a->z1 == b->z1 &&
+            a->x2 == b->x2 && a->y2 == b->y2 &&
+            a->bottom == b->bottom && a->top == b->top);
+}
+
+//
+// P_SightCacheLookup
+// Main thread only
+//
+
+static dboolean P_SightCacheLookup(sightkey_t *key, int set, dboolean *result) {
+    sightcache_t *entry;
+    int i;
+    int j;
+
+    if(!p_sightcache.value) {
+        return false;
+    }
+
+    entry = &sightcache[set * SIGHTCACHEWAYS];
+
+    for(i = 0; i < SIGHTCACHEWAYS; i++, entry++) {
+        if(!entry->stamp || !P_SightKeyMatch(&entry->key, key)) {
+            continue;
+        }
+
+        // any sector the trace read has moved since?
+        for(j = 0; j < entry->numsectors; j++) {
+            if(sightsectorstamp[entry->sectors[j]] > entry->stamp) {
+                break;
+            }
+        }
+
+        if(j < entry->numsectors) {
+            entry->stamp = 0;
+            break;
+        }
+
+        entry->lastused = gametic;
+        *result = entry->result;
+        sightcachehits++;
+
+        return true;
+    }
+
+    sightcachemisses++;
+
+    return false;
+}
+
+//
+// P_SightCacheStore
+// Main thread only
+//
+
+static void P_SightCacheStore(sightkey_t *key, int set, int numsectors,
+                              int *readsectors, dboolean result) {
+    sightcache_t *entry;
+    sightcache_t *victim;
+    int i;
+
+    if(numsectors > SIGHTCACHESECTORS || !p_sightcache.value) {
+        return;
+    }
+
+    entry = &sightcache[set * SIGHTCACHEWAYS];
+    victim = entry;
+
+    for(i = 0; i < SIGHTCACHEWAYS; i++, entry++) {
+        if(!entry->stamp || P_SightKeyMatch(&entry->key, key)) {
+            victim = entry;
+            break;
+        }
+
+        if(entry->lastused < victim->lastused) {
+            victim = entry;
+        }
+    }
+
+    victim->key = *key;
+    victim->stamp = sightclock;
+    victim->lastused = gametic;
+    victim->numsectors = numsectors;
+    victim->result = result;
+
+    dmemcpy(victim->sectors, readsectors, numsectors * sizeof(int));
+}
+
+//
+// P_SightSectorChanged
+// Called whenever a sector's floor or ceiling moves
+//
+
+void P_SightSectorChanged(sector_t *sector) {
+    if(sightsectorstamp) {
+        sightsectorstamp[sector - sectors] = ++sightclock;
+    }
+}
+
+//
+// P_ResetSightCache
+// Called from P_SetupLevel once the sectors are loaded
+//
+
+void P_ResetSightCache(void) {
+    dmemset(sightcache, 0, sizeof(sightcache));
+
+    sightsectorstamp = (unsigned int*)Z_Malloc(numsectors * sizeof(int), PU_LEVEL, 0);
+    dmemset(sightsectorstamp, 0, numsectors * sizeof(int));
+
+    sightclock = 1;
+    sightcachehits = 0;
+    sightcachemisses = 0;
+}
+
+//
+// P_SightCacheStats
+//
+
+void P_SightCacheStats(int *hits, int *misses) {
+    *hits = sightcachehits;
+    *misses = sightcachemisses;
+}
+
+//
+// P_CheckSight
+// Returns true if a straight line between t1 and t2 is unobstructed.
+// Uses REJECT.
+//
+
+dboolean P_CheckSight(mobj_t* t1, mobj_t* t2) {
+    sightctx_t *ctx = &sightctx[0];
+    sightkey_t key;
+    dboolean result;
+    int set;
+
+    P_SetupSightContext(ctx);
+
+    if(P_SightRejected(ctx, t1, t2)) {
+        result = false;
+    }
+    else {
+        set = P_SightCacheKey(t1, t2, &key);
+
+        if(!P_SightCacheLookup(&key, set, &result)) {
+            result = P_TraceSight(ctx, &key);
+            P_SightCacheStore(&key, set, ctx->numcachesectors, ctx->cachesectors, result);
+        }
+    }
+
+    sightcounts[0] += ctx->sightcounts[0];
+    sightcounts[1] += ctx->sightcounts[1];
+    ctx->sightcounts[0] = ctx->sightcounts[1] = 0;
+
+    return result;
+}
+
+//
+// P_RunSightJobs
+// Takes batches of jobs until there are none left
+//
+
+static void P_RunSightJobs(sightctx_t *ctx) {
+    sightjob_t *job;
+    int start;
+    int end;
+    int i;
+
+    while(1) {
+        start = SDL_AtomicAdd(&nextsightjob, SIGHTBATCH);
+
+        if(start >= numsightjobs) {
+            break;
+        }
+
+        end = MIN(start + SIGHTBATCH, numsightjobs);
+
+        for(i = start; i < end; i++) {
+            job = &sightjobs[i];
+
+            if(job->done) {
+                continue;
+            }
+
+            job->result = P_TraceSight(ctx, &job->key);
+            job->numsectors = ctx->numcachesectors;
+
+            if(job->numsectors <= SIGHTCACHESECTORS) {
+                dmemcpy(job->sectors, ctx->cachesectors, job->numsectors * sizeof(int));
+            }
+        }
+    }
+}
+
+//
+// P_SightThread
+//
+
+static int SDLCALL P_SightThread(void *data) {
+    int index = (int)(size_t)data;
+    int generation = 0;
+    dboolean active;
+
+    while(1) {
+        SDL_LockMutex(sightlock);
+
+        while(generation == sightgeneration) {
+            SDL_CondWait(sightstartcond, sightlock);
+        }
+
+        generation = sightgeneration;
+        active = (index <= activesightthreads);
+
+        SDL_UnlockMutex(sightlock);
+
+        if(!active) {
+            continue;
+        }
+
+        P_RunSightJobs(&sightctx[index]);
+
+        SDL_LockMutex(sightlock);
+
+        if(--sightpending == 0) {
+            SDL_CondSignal(sightdonecond);
+        }
+
+        SDL_UnlockMutex(sightlock);
+    }
+
+    return 0;
+}
+
+//
+// P_StartSightThreads
+//
+
+static void P_StartSightThreads(void) {
+    int count;
+    int i;
+
+    count = MIN(SDL_GetCPUCount(), MAXSIGHTTHREADS) - 1;
+    numsightthreads = 0;
+
+    if(count <= 0) {
+        return;
+    }
+
+    sightlock = SDL_CreateMutex();
+    sightstartcond = SDL_CreateCond();
+    sightdonecond = SDL_CreateCond();
+
+    if(!sightlock || !sightstartcond || !sightdonecond) {
+        return;
+    }
+
+    for(i = 1; i <= count; i++) {
+        if(!(sightthreads[i] = SDL_CreateThread(P_SightThread, "Sight", (void*)(size_t)i))) {
+            break;
+        }
+
+        numsightthreads++;
+    }
+}
+
+//
+// P_RunSightsParallel
+//
+
+static void P_RunSightsParallel(int numtraces) {
+    int threads;
+    int i;
+
+    if(numsightthreads == -1) {
+        P_StartSightThreads();
+    }
+
+    threads = numsightthreads;
+
+    if(p_sightthreads.value >= 1) {
+        threads = MIN(threads, (int)p_sightthreads.value - 1);
+    }
+
+    SDL_AtomicSet(&nextsightjob, 0);
+
+    if(threads <= 0 || numtraces < SIGHTMINPARALLEL) {
+        P_RunSightJobs(&sightctx[0]);
+        return;
+    }
+
+    for(i = 1; i <= threads; i++) {
+        P_SetupSightContext(&sightctx[i]);
+    }
+
+    SDL_LockMutex(sightlock);
+
+    activesightthreads = threads;
+    sightpending = threads;
+    sightgeneration++;
+
+    SDL_CondBroadcast(sightstartcond);
+    SDL_UnlockMutex(sightlock);
+
+    // the main thread takes jobs too
+    P_RunSightJobs(&sightctx[0]);
+
+    SDL_LockMutex(sightlock);
+
+    while(sightpending > 0) {
+        SDL_CondWait(sightdonecond, sightlock);
+    }
+
+    SDL_UnlockMutex(sightlock);
 }
 
 //
@@ -362,7 +866,15 @@ dboolean P_CheckSight(mobj_t* t1, mobj_t* t2) {
 //
 
 void P_ScanSights(void) {
+    sightjob_t *job;
     mobj_t* mobj;
+    int numtraces;
+    int i;
+
+    numsightjobs = 0;
+    numtraces = 0;
+
+    P_SetupSightContext(&sightctx[0]);
 
     for(mobj = mobjhead.next; mobj != &mobjhead; mobj = mobj->next) {
         // must be killable
@@ -382,11 +894,57 @@ void P_ScanSights(void) {
             continue;
         }
 
-        if(!P_CheckSight(mobj, mobj->target)) {
+        if(numsightjobs == maxsightjobs) {
+            maxsightjobs = maxsightjobs ? maxsightjobs * 2 : 256;
+            sightjobs = realloc(sightjobs, maxsightjobs * sizeof(sightjob_t));
+
+            if(sightjobs == NULL) {
+                I_Error("P_ScanSights: Couldn't realloc sightjobs");
+            }
+        }
+
+        job = &sightjobs[numsightjobs++];
+        job->mobj = mobj;
+        job->result = false;
+        job->done = true;
+
+        // rejection and cache hits are answered right here,
+        // everything else is traced in parallel below
+        if(P_SightRejected(&sightctx[0], mobj, mobj->target)) {
             continue;
         }
 
-        mobj->flags |= MF_SEETARGET;
+        job->set = P_SightCacheKey(mobj, mobj->target, &job->key);
+
+        if(!P_SightCacheLookup(&job->key, job->set, &job->result)) {
+            job->done = false;
+            numtraces++;
+        }
+    }
+
+    if(numtraces > 0) {
+        P_RunSightsParallel(numtraces);
+
+        for(i = 0; i < numsightjobs; i++) {
+            job = &sightjobs[i];
+
+            if(!job->done) {
+                P_SightCacheStore(&job->key, job->set, job->numsectors, job->sectors, job->result);
+            }
+        }
     }
-}
 
+    // nothing is changed until every check is done, and then
+    // in the same order the serial loop would have used
+    for(i = 0; i < numsightjobs; i++) {
+        if(sightjobs[i].result) {
+            sightjobs[i].mobj->flags |= MF_SEETARGET;
+        }
+    }
+
+    for(i = 0; i < MAXSIGHTTHREADS; i++) {
+        sightcounts[0] += sightctx[i].sightcounts[0];
+        sightcounts[1] += sightctx[i].sightcounts[1];
+        sightctx[i].sightcounts[0] = sightctx[i].sightcounts[1] = 0;
+    }
+}
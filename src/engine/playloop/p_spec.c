@@ -313,24 +313,50 @@ sector_t* getNextSector(line_t* line, sector_t* sec) {
 
 
 
+//
+// P_UpdateSectorEdges
+// Copies line flags into the adjacency graph
+// built by P_GroupLines
+//
+
+void P_UpdateSectorEdges(void) {
+    sectoredge_t *edge;
+    int i;
+    int j;
+
+    for(i = 0; i < numsectors; i++) {
+        for(j = 0, edge = sectors[i].edges; j < sectors[i].edgecount; j++, edge++) {
+            edge->flags = 0;
+
+            if(edge->line->flags & ML_TWOSIDED) {
+                edge->flags |= SEF_TWOSIDED;
+            }
+
+            if(edge->line->flags & ML_SOUNDBLOCK) {
+                edge->flags |= SEF_SOUNDBLOCK;
+            }
+        }
+    }
+}
+
+
+
 //
 // P_FindLowestFloorSurrounding()
 // FIND LOWEST FLOOR HEIGHT IN SURROUNDING SECTORS
 //
 fixed_t    P_FindLowestFloorSurrounding(sector_t* sec) {
     int            i;
-    line_t*        check;
     sector_t*      other;
     fixed_t        floor = sec->floorheight;
 
-    for(i=0 ; i < sec->linecount ; i++) {
-        check = sec->lines[i];
-        other = getNextSector(check,sec);
-
-        if(!other) {
+    for(i = 0; i < sec->edgecount; i++) {
+        if(!(sec->edges[i].flags & SEF_TWOSIDED)) {
             continue;
         }
 
+        other = sec->edges[i].other;
+
         if(other->floorheight < floor) {
             floor = other->floorheight;
         }
@@ -346,18 +372,16 @@ fixed_t    P_FindLowestFloorSurrounding(sector_t* sec) {
 //
 fixed_t    P_FindHighestFloorSurrounding(sector_t *sec) {
     int            i;
-    line_t*        check;
     sector_t*      other;
     fixed_t        floor = -500*FRACUNIT;
 
-    for(i=0 ; i < sec->linecount ; i++) {
-        check = sec->lines[i];
-        other = getNextSector(check,sec);
-
-        if(!other) {
+    for(i = 0; i < sec->edgecount; i++) {
+        if(!(sec->edges[i].flags & SEF_TWOSIDED)) {
             continue;
         }
 
+        other = sec->edges[i].other;
+
         if(other->floorheight > floor) {
             floor = other->floorheight;
         }
@@ -379,19 +403,17 @@ fixed_t P_FindNextHighestFloor(sector_t* sec, int currentheight) {
     int         i;
     int         h;
     int         min;
-    line_t*     check;
     sector_t*   other;
     fixed_t     height = currentheight;
     fixed_t     heightlist[MAX_ADJOINING_SECTORS];
 
-    for(i = 0, h = 0; i < sec->linecount; i++) {
-        check = sec->lines[i];
-        other = getNextSector(check,sec);
-
-        if(!other) {
+    for(i = 0, h = 0; i < sec->edgecount; i++) {
+        if(!(sec->edges[i].flags & SEF_TWOSIDED)) {
             continue;
         }
 
+        other = sec->edges[i].other;
+
         if(other->floorheight > height) {
             heightlist[h++] = other->floorheight;
         }
@@ -425,18 +447,16 @@ fixed_t P_FindNextHighestFloor(sector_t* sec, int currentheight) {
 //
 fixed_t P_FindLowestCeilingSurrounding(sector_t* sec) {
     int         i;
-    line_t*     check;
     sector_t*   other;
     fixed_t     height = D_MAXINT;
 
-    for(i = 0; i < sec->linecount; i++) {
-        check = sec->lines[i];
-        other = getNextSector(check,sec);
-
-        if(!other) {
+    for(i = 0; i < sec->edgecount; i++) {
+        if(!(sec->edges[i].flags & SEF_TWOSIDED)) {
             continue;
         }
 
+        other = sec->edges[i].other;
+
         if(other->ceilingheight < height) {
             height = other->ceilingheight;
         }
@@ -450,18 +470,16 @@ fixed_t P_FindLowestCeilingSurrounding(sector_t* sec) {
 //
 fixed_t    P_FindHighestCeilingSurrounding(sector_t* sec) {
     int         i;
-    line_t*     check;
     sector_t*   other;
     fixed_t     height = 0;
 
-    for(i = 0; i < sec->linecount; i++) {
-        check = sec->lines[i];
-        other = getNextSector(check,sec);
-
-        if(!other) {
+    for(i = 0; i < sec->edgecount; i++) {
+        if(!(sec->edges[i].flags & SEF_TWOSIDED)) {
             continue;
         }
 
+        other = sec->edges[i].other;
+
         if(other->ceilingheight > height) {
             height = other->ceilingheight;
         }
@@ -471,37 +489,96 @@ fixed_t    P_FindHighestCeilingSurrounding(sector_t* sec) {
 
 
 
+//
+// P_InitTagLists
+// Chains sectors and lines by tag. Every tag hashes to a bucket
+// whose head is firsttag of the sector or line with that index,
+// and each chain runs in ascending order so lookups return the
+// same matches, in the same order, as a scan of the whole map.
+// Must be rerun whenever tags change.
+//
+
+void P_InitTagLists(void) {
+    int i;
+    int j;
+
+    for(i = numsectors; --i >= 0;) {
+        sectors[i].firsttag = -1;
+    }
+
+    for(i = numsectors; --i >= 0;) {
+        j = (unsigned int)sectors[i].tag % (unsigned int)numsectors;
+        sectors[i].nexttag = sectors[j].firsttag;
+        sectors[j].firsttag = i;
+    }
+
+    for(i = numlines; --i >= 0;) {
+        lines[i].firsttag = -1;
+    }
+
+    for(i = numlines; --i >= 0;) {
+        j = (unsigned int)lines[i].tag % (unsigned int)numlines;
+        lines[i].nexttag = lines[j].firsttag;
+        lines[j].firsttag = i;
+    }
+}
+
 //
 // P_FindSectorFromLineTag
 // RETURN NEXT SECTOR # THAT LINE TAG REFERS TO
 //
 
 int P_FindSectorFromLineTag(line_t* line, int start) {
-    int    i;
+    return P_FindSectorFromTagStart(line->tag, start);
+}
 
-    for(i = start + 1; i < numsectors; i++) {
-        if(sectors[i].tag == line->tag) {
-            return i;
-        }
+//
+// P_FindSectorFromTagStart
+// Next sector after start with the given tag, -1 starts from the beginning
+//
+
+int P_FindSectorFromTagStart(int tag, int start) {
+    if(numsectors <= 0) {
+        return -1;
     }
-    return -1;
-}
 
+    start = (start >= 0) ? sectors[start].nexttag :
+            sectors[(unsigned int)tag % (unsigned int)numsectors].firsttag;
+
+    while(start >= 0 && sectors[start].tag != tag) {
+        start = sectors[start].nexttag;
+    }
+
+    return start;
+}
 
 //
-// P_FindLinedefFromTag
+// P_FindLineFromTagStart
+// Next line after start with the given tag, -1 starts from the beginning
 //
 
-int P_FindLinedefFromTag(int tag) {
-    int i = 0;
+int P_FindLineFromTagStart(int tag, int start) {
+    if(numlines <= 0) {
+        return -1;
+    }
 
-    for(i = 0; i < numlines; i++) {
-        if(lines[i].tag == tag) {
-            return i;
-        }
+    start = (start >= 0) ? lines[start].nexttag :
+            lines[(unsigned int)tag % (unsigned int)numlines].firsttag;
+
+    while(start >= 0 && lines[start].tag != tag) {
+        start = lines[start].nexttag;
     }
 
-    return -1;
+    return start;
+}
+
+
+//
+// P_FindLinedefFromTag
+//
+
+int P_FindLinedefFromTag(int tag) {
+    return P_FindLineFromTagStart(tag, -1);
 }
 
 //
@@ -510,15 +587,7 @@ int P_FindLinedefFromTag(int tag) {
 //
 
 int P_FindSectorFromTag(int tag) {
-    int i = 0;
-
-    for(i = 0; i < numsectors; i++) {
-        if(sectors[i].tag == tag) {
-            return i;
-        }
-    }
-
-    return -1;
+    return P_FindSectorFromTagStart(tag, -1);
 }
 
 //
@@ -526,12 +595,10 @@ int P_FindSectorFromTag(int tag) {
 //
 
 dboolean P_ActivateLineByTag(int tag, mobj_t* activator) {
-    int i;
+    int linenum;
 
-    for(i = 0; i < numlines; i++) {
-        if(lines[i].tag == tag) {
-            return P_UseSpecialLine(activator, &lines[i], 0);
-        }
+    if((linenum = P_FindLinedefFromTag(tag)) >= 0) {
+        return P_UseSpecialLine(activator, &lines[linenum], 0);
     }
 
     return 1;
@@ -548,7 +615,7 @@ typedef enum {
 } modifyline_t;
 
 static int P_ModifyLine(int tag1, int tag2, int type) {
-    int i = 0;
+    int i = -1;
     line_t* line1;
     line_t* line2;
     int linenum;
@@ -560,60 +627,63 @@ static int P_ModifyLine(int tag1, int tag2, int type) {
     
     line2 = &lines[linenum];
 
-    for(i = 0; i < numlines; i++) {
+    while((i = P_FindLineFromTagStart(tag1, i)) >= 0) {
         line1 = &lines[i];
-        if(line1->tag == tag1) {
-            switch(type) {
-            case modl_flags:
-                if(line1->flags & ML_TWOSIDED) {
-                    line1->flags = (line2->flags | ML_TWOSIDED);
-                }
-                else {
-                    line1->flags = line2->flags;
-                    line1->flags &= ~ML_TWOSIDED;
-                }
-                break;
-            case modl_texture:
-                sides[line1->sidenum[0]].bottomtexture = sides[line2->sidenum[0]].bottomtexture;
-                sides[line1->sidenum[0]].midtexture = sides[line2->sidenum[0]].midtexture;
-                sides[line1->sidenum[0]].toptexture = sides[line2->sidenum[0]].toptexture;
-
-                if(line1->flags & ML_TWOSIDED || line1->sidenum[1] != NO_SIDE_INDEX) {
-                    sides[line1->sidenum[1]].bottomtexture = sides[line2->sidenum[1]].bottomtexture;
-                    sides[line1->sidenum[1]].midtexture = sides[line2->sidenum[1]].midtexture;
-                    sides[line1->sidenum[1]].toptexture = sides[line2->sidenum[1]].toptexture;
-                }
 
-                if(line1->flags & ML_SWITCHX02 &&
-                        !sides[line1->sidenum[0]].toptexture) {
-                    line1->flags &= ~ML_SWITCHX02;
-                }
+        switch(type) {
+        case modl_flags:
+            if(line1->flags & ML_TWOSIDED) {
+                line1->flags = (line2->flags | ML_TWOSIDED);
+            }
+            else {
+                line1->flags = line2->flags;
+                line1->flags &= ~ML_TWOSIDED;
+            }
+            break;
+        case modl_texture:
+            sides[line1->sidenum[0]].bottomtexture = sides[line2->sidenum[0]].bottomtexture;
+            sides[line1->sidenum[0]].midtexture = sides[line2->sidenum[0]].midtexture;
+            sides[line1->sidenum[0]].toptexture = sides[line2->sidenum[0]].toptexture;
+
+            if(line1->flags & ML_TWOSIDED || line1->sidenum[1] != NO_SIDE_INDEX) {
+                sides[line1->sidenum[1]].bottomtexture = sides[line2->sidenum[1]].bottomtexture;
+                sides[line1->sidenum[1]].midtexture = sides[line2->sidenum[1]].midtexture;
+                sides[line1->sidenum[1]].toptexture = sides[line2->sidenum[1]].toptexture;
+            }
 
-                if(line1->flags & (ML_SWITCHX04 | ML_SWITCHX08) &&
-                        !sides[line1->sidenum[0]].bottomtexture) {
-                    line1->flags &= ~(ML_SWITCHX04 | ML_SWITCHX08);
-                }
+            if(line1->flags & ML_SWITCHX02 &&
+                    !sides[line1->sidenum[0]].toptexture) {
+                line1->flags &= ~ML_SWITCHX02;
+            }
 
-                if(line1->flags & (ML_SWITCHX02 | ML_SWITCHX04) &&
-                        !sides[line1->sidenum[0]].midtexture) {
-                    line1->flags &= ~(ML_SWITCHX02 | ML_SWITCHX04);
-                }
+            if(line1->flags & (ML_SWITCHX04 | ML_SWITCHX08) &&
+                    !sides[line1->sidenum[0]].bottomtexture) {
+                line1->flags &= ~(ML_SWITCHX04 | ML_SWITCHX08);
+            }
 
-                if(line1->flags & (ML_SWITCHX02 | ML_SWITCHX08) &&
-                        !sides[line1->sidenum[0]].toptexture) {
-                    line1->flags &= ~(ML_SWITCHX02 | ML_SWITCHX08);
-                }
+            if(line1->flags & (ML_SWITCHX02 | ML_SWITCHX04) &&
+                    !sides[line1->sidenum[0]].midtexture) {
+                line1->flags &= ~(ML_SWITCHX02 | ML_SWITCHX04);
+            }
 
-                break;
-            case modl_data:
-                line1->special = line2->special;
-                break;
-            default:
-                break;
+            if(line1->flags & (ML_SWITCHX02 | ML_SWITCHX08) &&
+                    !sides[line1->sidenum[0]].toptexture) {
+                line1->flags &= ~(ML_SWITCHX02 | ML_SWITCHX08);
             }
+
+            break;
+        case modl_data:
+            line1->special = line2->special;
+            break;
+        default:
+            break;
         }
     }
 
+    if(type == modl_flags) {
+        P_UpdateSectorEdges();
+    }
+
     return 1;
 }
 
@@ -666,6 +736,7 @@ static int P_ModifySector(line_t *line, int tag, int type) {
                 break;
             case mods_flags:
                 sec1->flags = sec2->flags;
+                P_UpdateScrollingSector(sec1);
                 break;
             default:
                 break;
@@ -726,9 +797,8 @@ int P_RandomLineTrigger(line_t* line, mobj_t* thing, int side) {
     int i = 0;
     int count = 0;
 
-    for(i = 0; i < numlines; i++) {
-        if(lines[i].tag == line->tag &&
-                SPECIALMASK(lines[i].special) != SPECIALMASK(line->special)) {
+    for(i = -1; (i = P_FindLineFromTagStart(line->tag, i)) >= 0;) {
+        if(SPECIALMASK(lines[i].special) != SPECIALMASK(line->special)) {
             count++;
         }
     }
@@ -739,9 +809,8 @@ int P_RandomLineTrigger(line_t* line, mobj_t* thing, int side) {
     linelist = (line_t **)Z_Malloc(count*sizeof(line_t *), PU_LEVEL, NULL);
     randLine = linelist;
 
-    for(i = 0; i < numlines; i++) {
-        if(lines[i].tag == line->tag &&
-                SPECIALMASK(lines[i].special) != SPECIALMASK(line->special)) {
+    for(i = -1; (i = P_FindLineFromTagStart(line->tag, i)) >= 0;) {
+        if(SPECIALMASK(lines[i].special) != SPECIALMASK(line->special)) {
             *randLine++ = &lines[i];
         }
     }
@@ -837,6 +906,10 @@ static void P_AlertTaggedMobj(mobj_t *activator, int tid) {
             continue;
         }
 
+        // its state is set by hand below, so it
+        // can't be left waiting on the scheduler
+        P_WakeMobj(mo);
+
         // [kex] TODO - there's no check if the mobj is already dead but
         // if it is, then just revive it. May need to add a feature
         // to skip dead mobjs sometime in the future
@@ -965,6 +1038,7 @@ void T_MovingCamera(movecamera_t* camera) {
     mobj_t* camtarget;
 
     camtarget = camera->player->cameratarget;
+    P_WakeMobj(camtarget);
 
     //
     // adjust angle
@@ -1054,6 +1128,8 @@ void P_SetMovingCamera(player_t* player, line_t* line) {
             continue;
         }
 
+        P_WakeMobj(mo);
+
         // setup moving camera
         camera->x = mo->x;
         camera->y = mo->y;
@@ -1096,6 +1172,7 @@ static dboolean P_ModifyMobjFlags(int tid, int flags) {
 
         ok = true;
 
+        P_WakeMobj(mo);
         mo->flags &= ~flags;
     }
 
@@ -1849,10 +1926,66 @@ int             levelTimeCount;
 extern line_t** linespeciallist;
 extern short    numlinespecials;
 
+static sector_t**   scrollsectors;
+static int          numscrollsectors;
+static int          maxscrollsectors;
+
+//
+// P_UpdateScrollingSector
+// Adds or drops the sector from the scrolling list to match
+// its flags. Needed whenever sector flags change during play
+//
+
+void P_UpdateScrollingSector(sector_t* sector) {
+    int i;
+
+    for(i = 0; i < numscrollsectors; i++) {
+        if(scrollsectors[i] == sector) {
+            break;
+        }
+    }
+
+    if(sector->flags & (MS_SCROLLFLOOR|MS_SCROLLCEILING)) {
+        if(i == numscrollsectors) {
+            scrollsectors[numscrollsectors++] = sector;
+        }
+    }
+    else if(i < numscrollsectors) {
+        scrollsectors[i] = scrollsectors[--numscrollsectors];
+    }
+}
+
+//
+// P_InitScrollingSectors
+// Loading a savegame or rewinding calls this again on the same
+// level, so the list is kept until the level goes, which
+// clears scrollsectors
+//
+
+void P_InitScrollingSectors(void) {
+    int i;
+
+    if(scrollsectors == NULL || maxscrollsectors < numsectors) {
+        maxscrollsectors = MAX(numsectors, 1);
+        scrollsectors = Z_Realloc(scrollsectors, maxscrollsectors * sizeof(sector_t*),
+                                  PU_LEVEL, &scrollsectors);
+    }
+
+    numscrollsectors = 0;
+
+    for(i = 0; i < numsectors; i++) {
+        if(sectors[i].flags & (MS_SCROLLFLOOR|MS_SCROLLCEILING)) {
+            scrollsectors[numscrollsectors++] = &sectors[i];
+        }
+    }
+}
+
 void P_UpdateSpecials(void) {
     int         i;
+    int         j;
     line_t*     line;
     sector_t*   sector;
+    button_t*   button;
 
     //    LEVEL TIMER
     if(levelTimer == true) {
@@ -1886,33 +2019,30 @@ void P_UpdateSpecials(void) {
     }
 
     // UPDATE SCROLLING FLATS
-    for(i = 0; i < numsectors; i++) {
-        sector = &sectors[i];
+    for(i = 0; i < numscrollsectors; i++) {
+        fixed_t speed;
 
-        if(sector->flags & (MS_SCROLLFLOOR|MS_SCROLLCEILING)) {
-            fixed_t speed;
+        sector = scrollsectors[i];
 
-            if(sector->flags & MS_SCROLLFAST) {
-                speed = 3*FRACUNIT;
-            }
-            else {
-                speed = FRACUNIT;
-            }
-
-            if(sector->flags & MS_SCROLLLEFT) {
-                sector->xoffset += speed;
-            }
-            if(sector->flags & MS_SCROLLRIGHT) {
-                sector->xoffset -= speed;
-            }
-            if(sector->flags & MS_SCROLLUP) {
-                sector->yoffset += speed;
-            }
-            if(sector->flags & MS_SCROLLDOWN) {
-                sector->yoffset -= speed;
-            }
+        if(sector->flags & MS_SCROLLFAST) {
+            speed = 3*FRACUNIT;
+        }
+        else {
+            speed = FRACUNIT;
         }
 
+        if(sector->flags & MS_SCROLLLEFT) {
+            sector->xoffset += speed;
+        }
+        if(sector->flags & MS_SCROLLRIGHT) {
+            sector->xoffset -= speed;
+        }
+        if(sector->flags & MS_SCROLLUP) {
+            sector->yoffset += speed;
+        }
+        if(sector->flags & MS_SCROLLDOWN) {
+            sector->yoffset -= speed;
+        }
     }
 
     // SKY TICKER
@@ -1921,33 +2051,42 @@ void P_UpdateSpecials(void) {
     }
 
     // DO BUTTONS
-    for(i = 0; i < MAXBUTTONS; i++) {
-        if(buttonlist[i].btimer) {
-            buttonlist[i].btimer--;
-            if(!buttonlist[i].btimer) {
-                switch(buttonlist[i].where) {
+    for(i = 0, j = 0; i < numactivebuttons; i++) {
+        button = &buttonlist[activebuttons[i]];
+
+        if(button->btimer) {
+            button->btimer--;
+            if(!button->btimer) {
+                switch(button->where) {
                 case top:
-                    sides[buttonlist[i].line->sidenum[0]].toptexture =
-                        buttonlist[i].btexture ^ 1;
+                    sides[button->line->sidenum[0]].toptexture =
+                        button->btexture ^ 1;
                     break;
 
                 case middle:
-                    sides[buttonlist[i].line->sidenum[0]].midtexture =
-                        buttonlist[i].btexture ^ 1;
+                    sides[button->line->sidenum[0]].midtexture =
+                        button->btexture ^ 1;
                     break;
 
                 case bottom:
-                    sides[buttonlist[i].line->sidenum[0]].bottomtexture =
-                        buttonlist[i].btexture ^ 1;
+                    sides[button->line->sidenum[0]].bottomtexture =
+                        button->btexture ^ 1;
                     break;
                 }
 
-                S_StartSound((mobj_t *)&buttonlist[i].line->frontsector->soundorg, sfx_switch1);
-                dmemset(&buttonlist[i],0,sizeof(button_t));
+                S_StartSound((mobj_t *)&button->line->frontsector->soundorg, sfx_switch1);
+                dmemset(button,0,sizeof(button_t));
             }
         }
+
+        // finished buttons drop out of the queue
+        if(button->btimer) {
+            activebuttons[j++] = activebuttons[i];
+        }
     }
 
+    numactivebuttons = j;
+
     scrollfrac += (FRACUNIT / 2);
 }
 
@@ -2131,14 +2270,20 @@ void P_SpawnSpecials(void) {
     }
 
     //    Init line EFFECTs
+    //    counted first, the list lives in the level arena
+    numlinespecials = 0;
+    for(i = 0; i < numlines; i++) {
+        if(lines[i].flags & (ML_SCROLLRIGHT|ML_SCROLLLEFT|ML_SCROLLUP|ML_SCROLLDOWN)) {
+            numlinespecials++;
+        }
+    }
+
+    linespeciallist = Z_Malloc(sizeof(line_t*) * (numlinespecials + 1), PU_LEVEL, 0);
     numlinespecials = 0;
-    linespeciallist = Z_Malloc(sizeof(line_t*) * 1, PU_LEVEL, 0);
+
     for(i = 0; i < numlines; i++) {
-        if(lines[i].flags & ML_SCROLLRIGHT || lines[i].flags & ML_SCROLLLEFT
-                || lines[i].flags & ML_SCROLLUP || lines[i].flags & ML_SCROLLDOWN) {
+        if(lines[i].flags & (ML_SCROLLRIGHT|ML_SCROLLLEFT|ML_SCROLLUP|ML_SCROLLDOWN)) {
             linespeciallist[numlinespecials++] = &lines[i];
-            linespeciallist = (line_t**)Z_Realloc(linespeciallist,
-                                                  (numlinespecials+1) * sizeof(line_t*), PU_LEVEL, 0);
         }
     }
 
@@ -2154,5 +2299,9 @@ void P_SpawnSpecials(void) {
     for(i = 0; i < MAXBUTTONS; i++) {
         dmemset(&buttonlist[i],0,sizeof(button_t));
     }
+
+    numactivebuttons = 0;
+
+    P_InitScrollingSectors();
 }
 
@@ -69,6 +69,19 @@ fixed_t     P_FindNextHighestFloor(sector_t* sec, int currentheight);
 fixed_t     P_FindLowestCeilingSurrounding(sector_t* sec);
 fixed_t     P_FindHighestCeilingSurrounding(sector_t* sec);
 int         P_FindSectorFromLineTag(line_t* line, int start);
+int         P_FindSectorFromTagStart(int tag, int start);
+int         P_FindLineFromTagStart(int tag, int start);
+int         P_FindSectorFromTag(int tag);
+int         P_FindLinedefFromTag(int tag);
+
+// rebuild whenever sector or line tags change
+void        P_InitTagLists(void);
+
+// refresh whenever line flags change
+void        P_UpdateSectorEdges(void);
+
+void        P_InitScrollingSectors(void);
+void        P_UpdateScrollingSector(sector_t* sector);
 dboolean    P_ActivateLineByTag(int tag, mobj_t* activator);
 
 
@@ -160,6 +173,7 @@ void        T_LightFlash(lightflash_t* flash);
 void        P_SpawnLightFlash(sector_t* sector);
 void        T_StrobeFlash(strobe_t* flash);
 void        T_FireFlicker(fireflicker_t* flick);
+int*        P_LightCountdown(thinker_t* thinker);
 void        P_UpdateLightThinker(light_t* destlight, light_t* srclight);
 void        T_Sequence(sequenceGlow_t* seq);
 void        P_SpawnStrobeFlash(sector_t* sector, int speed);
@@ -204,6 +218,10 @@ typedef struct {
 
 extern button_t    buttonlist[MAXBUTTONS];
 
+// slots of buttonlist still counting down, in slot order
+extern int         activebuttons[MAXBUTTONS];
+extern int         numactivebuttons;
+
 void P_ChangeSwitchTexture(line_t* line, int useAgain);
 
 
@@ -41,6 +41,9 @@
 
 button_t buttonlist[MAXBUTTONS];
 
+int activebuttons[MAXBUTTONS];
+int numactivebuttons;
+
 
 //
 // P_StartButton
@@ -49,10 +52,11 @@ button_t buttonlist[MAXBUTTONS];
 
 void P_StartButton(line_t* line, bwhere_e w, int texture, int time) {
     int    i;
+    int    j;
 
     // See if button is already pressed
-    for(i = 0; i < MAXBUTTONS; i++) {
-        if(buttonlist[i].btimer && buttonlist[i].line == line) {
+    for(i = 0; i < numactivebuttons; i++) {
+        if(buttonlist[activebuttons[i]].line == line) {
             return;
         }
     }
@@ -68,6 +72,14 @@ void P_StartButton(line_t* line, bwhere_e w, int texture, int time) {
                 buttonlist[i].soundorg = (mobj_t *)&line->frontsector->soundorg;
             }
 
+            // keep the queue in slot order
+            for(j = numactivebuttons; j > 0 && activebuttons[j - 1] > i; j--) {
+                activebuttons[j] = activebuttons[j - 1];
+            }
+
+            activebuttons[j] = i;
+            numactivebuttons++;
+
             return;
         }
     }
@@ -27,6 +27,8 @@
 //
 //-----------------------------------------------------------------------------
 
+#include <stddef.h>
+
 #include "doomstat.h"
 #include "z_zone.h"
 #include "p_local.h"
@@ -40,6 +42,8 @@
 #include "r_wipe.h"
 #include "p_setup.h"
 #include "g_demo.h"
+#include "d_profile.h"
+#include "p_saveg.h"
 
 CVAR_EXTERNAL(i_interpolateframes);
 CVAR_EXTERNAL(p_damageindicator);
@@ -75,6 +79,9 @@ thinker_t   *currentthinker;
 void P_InitThinkers(void) {
     thinkercap.prev = thinkercap.next  = &thinkercap;
     mobjhead.next = mobjhead.prev = &mobjhead;
+
+    P_SchedClear(&thinkerqueue);
+    P_SchedClear(&mobjqueue);
 }
 
 //
@@ -87,6 +94,8 @@ void P_AddThinker(thinker_t* thinker) {
     thinker->next = &thinkercap;
     thinker->prev = thinkercap.prev;
     thinkercap.prev = thinker;
+
+    P_SchedLink(&thinkerqueue, &thinker->sched);
 }
 
 //
@@ -97,6 +106,7 @@ static void P_UnlinkThinker(thinker_t* thinker) {
     thinker_t* next = currentthinker->next;
     (next->prev = currentthinker = thinker->prev)->next = next;
 
+    P_SchedUnlink(&thinkerqueue, &thinker->sched);
     Z_Free(thinker);
 }
 
@@ -107,6 +117,7 @@ static void P_UnlinkThinker(thinker_t* thinker) {
 //
 
 void P_RemoveThinker(thinker_t* thinker) {
+    P_WakeThinker(thinker);
     thinker->function.acp1 = P_UnlinkThinker;
     P_MacroDetachThinker(thinker);
 }
@@ -120,6 +131,8 @@ void P_LinkMobj(mobj_t* mobj) {
     mobj->next = &mobjhead;
     mobj->prev = mobjhead.prev;
     mobjhead.prev = mobj;
+
+    P_SchedLink(&mobjqueue, &mobj->sched);
 }
 
 //
@@ -135,44 +148,80 @@ void P_UnlinkMobj(mobj_t* mobj) {
     * point it to mobj->prev, so the iterator will correctly move on to
     * mobj->prev->next = mobj->next */
     (next->prev = currentmobj = mobj->prev)->next = next;
+
+    P_SchedUnlink(&mobjqueue, &mobj->sched);
 }
 
 //
-// P_RunMobjs
+// P_RunMobj
 //
 
-void P_RunMobjs(void) {
-    for(currentmobj = mobjhead.next; currentmobj != &mobjhead; currentmobj = currentmobj->next) {
-        if(!currentmobj) {
-            CON_Warnf("P_RunMobjs: Null mobj in linked list!\n");
-            break;
-        }
+static void P_RunMobj(mobj_t* mobj) {
+    // Special case only
+    if(mobj->flags & MF_NOSECTOR) {
+        return;
+    }
 
-        // Special case only
-        if(currentmobj->flags & MF_NOSECTOR) {
-            continue;
+    if(gameflags & GF_LOCKMONSTERS && !mobj->player && mobj->flags & MF_COUNTKILL) {
+        return;
+    }
+
+    if(!mobj->player) {
+        // [kex] don't bother if about to be removed
+        if(mobj->mobjfunc != P_SafeRemoveMobj) {
+            // [kex] don't clear callback if mobj is going to be respawning
+            if(mobj->mobjfunc != P_RespawnSpecials) {
+                mobj->mobjfunc = NULL;
+            }
+
+            P_MobjThinker(mobj);
         }
 
-        if(gameflags & GF_LOCKMONSTERS && !currentmobj->player && currentmobj->flags & MF_COUNTKILL) {
-            continue;
+        if(mobj->mobjfunc) {
+            mobj->mobjfunc(mobj);
         }
+    }
+}
+
+//
+// P_RunMobjs
+//
 
-        if(!currentmobj->player) {
-            // [kex] don't bother if about to be removed
-            if(currentmobj->mobjfunc != P_SafeRemoveMobj) {
-                // [kex] don't clear callback if mobj is going to be respawning
-                if(currentmobj->mobjfunc != P_RespawnSpecials) {
-                    currentmobj->mobjfunc = NULL;
-                }
+void P_RunMobjs(void) {
+    schednode_t* node;
+    mobj_t* mobj;
 
-                P_MobjThinker(currentmobj);
-            }
+    if(!P_SchedEnabled()) {
+        P_WakeAll();
 
-            if(currentmobj->mobjfunc) {
-                currentmobj->mobjfunc(currentmobj);
+        for(currentmobj = mobjhead.next; currentmobj != &mobjhead; currentmobj = currentmobj->next) {
+            if(!currentmobj) {
+                CON_Warnf("P_RunMobjs: Null mobj in linked list!\n");
+                break;
             }
+
+            P_RunMobj(currentmobj);
+        }
+
+        return;
+    }
+
+    // walk the run list instead, parking whatever
+    // is left with nothing to do but count down
+    P_SchedBeginPass(&mobjqueue);
+
+    while((node = P_SchedNext(&mobjqueue))) {
+        mobj = currentmobj = (mobj_t*)((byte*)node - offsetof(mobj_t, sched));
+
+        P_RunMobj(mobj);
+
+        // not if it was just freed
+        if(currentmobj == mobj) {
+            P_SchedParkMobj(mobj);
         }
     }
+
+    P_SchedEndPass(&mobjqueue);
 }
 
 //
@@ -180,13 +229,39 @@ void P_RunMobjs(void) {
 //
 
 void P_RunThinkers(void) {
-    for(currentthinker = thinkercap.next;
-            currentthinker != &thinkercap;
-            currentthinker = currentthinker->next) {
-        if(currentthinker->function.acp1) {
-            currentthinker->function.acp1(currentthinker);
+    schednode_t* node;
+    thinker_t* thinker;
+
+    if(!P_SchedEnabled()) {
+        P_WakeAll();
+
+        for(currentthinker = thinkercap.next;
+                currentthinker != &thinkercap;
+                currentthinker = currentthinker->next) {
+            if(currentthinker->function.acp1) {
+                currentthinker->function.acp1(currentthinker);
+            }
+        }
+
+        return;
+    }
+
+    P_SchedVerify();
+    P_SchedBeginPass(&thinkerqueue);
+
+    while((node = P_SchedNext(&thinkerqueue))) {
+        thinker = currentthinker = (thinker_t*)((byte*)node - offsetof(thinker_t, sched));
+
+        if(thinker->function.acp1) {
+            thinker->function.acp1(thinker);
+        }
+
+        if(currentthinker == thinker) {
+            P_SchedParkThinker(thinker);
         }
     }
+
+    P_SchedEndPass(&thinkerqueue);
 }
 
 //
@@ -423,6 +498,8 @@ int P_Ticker(void) {
         return 0;
     }
 
+    D_ProfBegin(PROF_PTICKER);
+
     for(i = 0; i < MAXPLAYERS; i++) {
         if(playeringame[i]) {
             // do player reborns if needed
@@ -434,10 +511,22 @@ int P_Ticker(void) {
         }
     }
 
+    D_ProfBegin(PROF_RUNTHINKERS);
     P_RunThinkers();
+    D_ProfEnd(PROF_RUNTHINKERS);
+
+    D_ProfBegin(PROF_SCANSIGHTS);
     P_ScanSights();
+    D_ProfEnd(PROF_SCANSIGHTS);
+
+    D_ProfBegin(PROF_RUNMOBJS);
     P_RunMobjs();
+    D_ProfEnd(PROF_RUNMOBJS);
+
+    D_ProfBegin(PROF_UPDATESPECIALS);
     P_UpdateSpecials();
+    D_ProfEnd(PROF_UPDATESPECIALS);
+
     P_RunMacros();
 
     ST_Ticker();
@@ -446,6 +535,10 @@ int P_Ticker(void) {
     // for par times
     leveltime++;
 
+    P_CaptureSnapshot();
+
+    D_ProfEnd(PROF_PTICKER);
+
     return gameaction;
 }
 
@@ -28,6 +28,7 @@
 #include "doomdef.h"
 #include "doomstat.h"
 #include "d_devstat.h"
+#include "d_profile.h"
 #include "r_local.h"
 #include "gl_texture.h"
 #include "gl_main.h"
@@ -111,6 +112,8 @@ void DL_ProcessDrawList(int tag, dboolean(*procfunc)(vtxlist_t*, int*)) {
 
     dl = &drawlist[tag];
 
+    D_ProfBegin(PROF_DRAWLIST);
+
     if(dl->max > 0) {
         int palette = 0;
 
@@ -208,6 +211,8 @@ void DL_ProcessDrawList(int tag, dboolean(*procfunc)(vtxlist_t*, int*)) {
             head->data = NULL;
         }
     }
+
+    D_ProfEnd(PROF_DRAWLIST);
 }
 
 //
@@ -31,6 +31,7 @@
 #include "doomstat.h"
 #include "i_video.h"
 #include "d_devstat.h"
+#include "d_profile.h"
 #include "r_local.h"
 #include "r_sky.h"
 #include "r_clipper.h"
@@ -363,6 +364,10 @@ void R_PrecacheLevel(void) {
     int num;
     mobj_t* mo;
 
+    if(nodrawers) {
+        return;
+    }
+
     CON_DPrintf("--------R_PrecacheLevel--------\n");
     GL_DumpTextures();
 
@@ -805,6 +810,8 @@ static void R_DrawContextWall(line_t* line) {
 //
 
 void R_RenderPlayerView(player_t *player) {
+    D_ProfBegin(PROF_RENDERVIEW);
+
     if(!r_fillmode.value) {
         dglPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
     }
@@ -918,6 +925,8 @@ void R_RenderPlayerView(player_t *player) {
     // check for new console commands
     //
     NetUpdate();
+
+    D_ProfEnd(PROF_RENDERVIEW);
 }
 
 //
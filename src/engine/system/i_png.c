@@ -240,7 +240,7 @@ Pixmap *I_PNGReadData(int lump, dboolean palette, dboolean nopack, dboolean alph
                             pal[i].blue = pallump[i].blue;
                         }
 
-                        Z_Free(pallump);
+                        W_UnlockLumpName(palname);
                     }
                     // villsa 12/04/13: if we're loading texture palette as normal
                     // but palindex is not zero, then just copy out a single row from the
@@ -289,6 +289,7 @@ Pixmap *I_PNGReadData(int lump, dboolean palette, dboolean nopack, dboolean alph
         break;
 
     default:
+        W_UnlockLumpNum(lump);
         return NULL;
         break;
     }
@@ -317,11 +318,94 @@ Pixmap *I_PNGReadData(int lump, dboolean palette, dboolean nopack, dboolean alph
 
     //cleanup
     Z_Free(row_pointers);
+    W_UnlockLumpNum(lump);
 //    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
 
     return pixmap;
 }
 
+//
+// I_PNGReadHeader
+// Walks the chunks in front of the image data to get the
+// dimensions and grAb offsets without decoding anything.
+// Returns false if the lump doesn't look like a PNG.
+//
+
+dboolean I_PNGReadHeader(int lump, int* w, int* h, int* offset) {
+    byte*       lumpdata;
+    int         length;
+    int         pos;
+    dboolean    gotheader;
+    dboolean    hastrans;
+
+    length = W_LumpLength(lump);
+
+    if(length < 8 + 12 + 13) {
+        return false;
+    }
+
+    lumpdata = W_CacheLumpNum(lump, PU_STATIC);
+
+    if(png_sig_cmp(lumpdata, 0, 8)) {
+        W_UnlockLumpNum(lump);
+        return false;
+    }
+
+    if(offset) {
+        offset[0] = 0;
+        offset[1] = 0;
+    }
+
+    gotheader = false;
+    hastrans = false;
+
+    for(pos = 8; pos + 8 <= length;) {
+        int size = I_SwapBE32(*(int*)(lumpdata + pos));
+        byte* chunk = lumpdata + pos + 4;
+        byte* data = chunk + 4;
+
+        if(size < 0 || size > length - pos - 12) {
+            break;
+        }
+
+        if(!dstrncmp((char*)chunk, "IHDR", 4) && size >= 8) {
+            if(w) {
+                *w = I_SwapBE32(*(int*)(data));
+            }
+            if(h) {
+                *h = I_SwapBE32(*(int*)(data + 4));
+            }
+
+            gotheader = true;
+        }
+        else if(!dstrncmp((char*)chunk, "grAb", 4) && size >= 8) {
+            if(offset) {
+                offset[0] = I_SwapBE32(*(int*)(data));
+                offset[1] = I_SwapBE32(*(int*)(data + 4));
+            }
+        }
+        else if(!dstrncmp((char*)chunk, "tRNS", 4) && size > 0) {
+            hastrans = true;
+        }
+        else if(!dstrncmp((char*)chunk, "IDAT", 4) ||
+                !dstrncmp((char*)chunk, "IEND", 4)) {
+            break;
+        }
+
+        pos += size + 12;
+    }
+
+    // I_PNGReadData usually wants it next
+    W_UnlockLumpNum(lump);
+
+    // same sanity check I_PNGReadData does for non-alpha reads
+    if(usingGL && hastrans) {
+        I_Error("I_PNGReadHeader: RGB8 PNG image (%s) has transparency", lumpinfo[lump].name);
+    }
+
+    return gotheader;
+}
+
 //
 // I_PNGWriteFunc
 //
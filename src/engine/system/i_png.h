@@ -31,6 +31,8 @@
 Pixmap *I_PNGReadData(int lump, dboolean palette, dboolean nopack, dboolean alpha,
                     int* w, int* h, int* offset, int palindex);
 
+dboolean I_PNGReadHeader(int lump, int* w, int* h, int* offset);
+
 byte* I_PNGCreate(int width, int height, byte* data, int* size);
 
 #endif // __I_PNG_H__
\ No newline at end of file
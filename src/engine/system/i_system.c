@@ -47,6 +47,8 @@
 #include "i_system.h"
 #include "i_audio.h"
 #include "gl_draw.h"
+#include "p_saveg.h"
+#include "w_prefetch.h"
 
 CVAR(i_interpolateframes, 0);
 
@@ -553,7 +555,16 @@ void I_Init(void) {
     //I_SpawnLauncher(hwndMain);
 #endif
 
-    I_InitVideo();
+    if(nodrawers) {
+        // no window, but input polling and timers still need SDL
+        if(SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS) < 0) {
+            I_Error("ERROR - Failed to initialize SDL");
+        }
+    }
+    else {
+        I_InitVideo();
+    }
+
     I_InitClockRate();
 }
 
@@ -624,6 +635,10 @@ void I_Quit(void) {
 
     M_SaveDefaults();
 
+    // don't cut off a save still being written
+    P_WaitSaveGame();
+    W_ShutdownPrefetch();
+
 #ifdef USESYSCONSOLE
     I_DestroySysConsole();
 #endif
@@ -0,0 +1,458 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// Copyright(C) 2005 Simon Howard
+// Copyright(C) 2007-2012 Samuel Villarreal
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+//-----------------------------------------------------------------------------
+//
+// DESCRIPTION:
+//    Netgame WAD checksum. Every loaded file contributes an MD5 of its
+//    contents. Those digests are kept in wadsums.dat keyed by the file's
+//    path, size and modification time, so a file only gets read again
+//    after it changes. Files that do need hashing are spread across
+//    worker threads. The merged lump directory is hashed on top of the
+//    file digests. Digests of files that aren't loaded are kept for as
+//    long as those files stay unchanged.
+//
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "SDL.h"
+
+#include "doomdef.h"
+#include "i_system.h"
+#include "w_wad.h"
+#include "w_checksum.h"
+
+#define WADSUMS_FILE        "wadsums.dat"
+#define WADSUMS_ID          "WSM1"
+#define WADSUMS_MAXTHREADS  4
+#define WADSUMS_READSIZE    0x10000
+
+typedef struct {
+    char*           path;
+    unsigned int    length;
+    unsigned int    mtime;
+    md5_digest_t    digest;
+    dboolean        keep;       // not loaded this session but still valid
+} sumentry_t;
+
+typedef struct {
+    wad_file_t*     wadfile;
+    unsigned int    mtime;
+    md5_digest_t    digest;
+    dboolean        hashed;
+} sumfile_t;
+
+static sumentry_t*  sumentries = NULL;
+static int          numsumentries = 0;
+
+static sumfile_t*   sumfiles = NULL;
+static int          numsumfiles = 0;
+
+static SDL_mutex*   sumlock = NULL;
+static int          nextsumfile = 0;
+
+static md5_digest_t wadchecksum;
+static dboolean     wadchecksumvalid = false;
+
+//
+// W_LoadWadSums
+//
+
+static void W_LoadWadSums(void) {
+    FILE *f;
+    char *path;
+    char id[4];
+    int count;
+    int len;
+    int i;
+
+    if(!(path = I_GetUserFile(WADSUMS_FILE))) {
+        return;
+    }
+
+    f = fopen(path, "rb");
+    free(path);
+
+    if(!f) {
+        return;
+    }
+
+    if(fread(id, 1, 4, f) != 4 || dstrncmp(id, WADSUMS_ID, 4) ||
+            fread(&count, sizeof(int), 1, f) != 1 || count < 0 || count > 0x10000) {
+        fclose(f);
+        return;
+    }
+
+    sumentries = calloc(count, sizeof(sumentry_t));
+
+    for(i = 0; i < count; i++) {
+        sumentry_t *entry = &sumentries[numsumentries];
+
+        if(fread(&len, sizeof(int), 1, f) != 1 || len <= 0 || len > 4096) {
+            break;
+        }
+
+        entry->path = malloc(len + 1);
+
+        if(fread(entry->path, 1, len, f) != (size_t)len ||
+                fread(&entry->length, sizeof(int), 1, f) != 1 ||
+                fread(&entry->mtime, sizeof(int), 1, f) != 1 ||
+                fread(entry->digest, sizeof(md5_digest_t), 1, f) != 1) {
+            free(entry->path);
+            break;
+        }
+
+        entry->path[len] = 0;
+        numsumentries++;
+    }
+
+    fclose(f);
+}
+
+//
+// W_SaveWadSums
+// The files loaded this session are written back,
+// along with any other file that hasn't changed
+//
+
+static void W_SaveWadSums(void) {
+    FILE *f;
+    char *path;
+    int count;
+    int len;
+    int i;
+
+    if(!(path = I_GetUserFile(WADSUMS_FILE))) {
+        return;
+    }
+
+    f = fopen(path, "wb");
+    free(path);
+
+    if(!f) {
+        return;
+    }
+
+    count = numsumfiles;
+
+    for(i = 0; i < numsumentries; i++) {
+        if(sumentries[i].keep) {
+            count++;
+        }
+    }
+
+    fwrite(WADSUMS_ID, 1, 4, f);
+    fwrite(&count, sizeof(int), 1, f);
+
+    for(i = 0; i < numsumfiles; i++) {
+        sumfile_t *sf = &sumfiles[i];
+
+        len = dstrlen(sf->wadfile->path);
+
+        fwrite(&len, sizeof(int), 1, f);
+        fwrite(sf->wadfile->path, 1, len, f);
+        fwrite(&sf->wadfile->length, sizeof(int), 1, f);
+        fwrite(&sf->mtime, sizeof(int), 1, f);
+        fwrite(sf->digest, sizeof(md5_digest_t), 1, f);
+    }
+
+    for(i = 0; i < numsumentries; i++) {
+        sumentry_t *entry = &sumentries[i];
+
+        if(!entry->keep) {
+            continue;
+        }
+
+        len = dstrlen(entry->path);
+
+        fwrite(&len, sizeof(int), 1, f);
+        fwrite(entry->path, 1, len, f);
+        fwrite(&entry->length, sizeof(int), 1, f);
+        fwrite(&entry->mtime, sizeof(int), 1, f);
+        fwrite(entry->digest, sizeof(md5_digest_t), 1, f);
+    }
+
+    fclose(f);
+}
+
+//
+// W_GetSumFile
+// Returns the index of the file, adding it in the
+// order it is first seen in the directory
+//
+
+static int W_GetSumFile(wad_file_t *wadfile) {
+    int i;
+
+    for(i = 0; i < numsumfiles; i++) {
+        if(sumfiles[i].wadfile == wadfile) {
+            return i;
+        }
+    }
+
+    sumfiles = realloc(sumfiles, (numsumfiles + 1) * sizeof(sumfile_t));
+    dmemset(&sumfiles[numsumfiles], 0, sizeof(sumfile_t));
+    sumfiles[numsumfiles].wadfile = wadfile;
+
+    return numsumfiles++;
+}
+
+//
+// W_HashWadFile
+// Worker side. Mapped files are hashed straight out of
+// the mapping, anything else is read through its own stream
+//
+
+static dboolean W_HashWadFile(sumfile_t *sf) {
+    md5_context_t md5_context;
+    byte *buf;
+    size_t len;
+    FILE *f;
+
+    MD5_Init(&md5_context);
+
+    if(sf->wadfile->mapped) {
+        MD5_Update(&md5_context, sf->wadfile->mapped, sf->wadfile->length);
+        MD5_Final(sf->digest, &md5_context);
+        return true;
+    }
+
+    if(!(f = fopen(sf->wadfile->path, "rb"))) {
+        return false;
+    }
+
+    if(!(buf = malloc(WADSUMS_READSIZE))) {
+        fclose(f);
+        return false;
+    }
+
+    while((len = fread(buf, 1, WADSUMS_READSIZE, f)) > 0) {
+        MD5_Update(&md5_context, buf, len);
+    }
+
+    free(buf);
+    fclose(f);
+
+    MD5_Final(sf->digest, &md5_context);
+    return true;
+}
+
+//
+// W_WadSumThread
+//
+
+static int SDLCALL W_WadSumThread(void *data) {
+    sumfile_t *sf;
+
+    while(1) {
+        SDL_LockMutex(sumlock);
+
+        sf = NULL;
+
+        while(nextsumfile < numsumfiles) {
+            if(!sumfiles[nextsumfile].hashed) {
+                sf = &sumfiles[nextsumfile++];
+                break;
+            }
+
+            nextsumfile++;
+        }
+
+        SDL_UnlockMutex(sumlock);
+
+        if(sf == NULL) {
+            break;
+        }
+
+        sf->hashed = W_HashWadFile(sf);
+    }
+
+    return 0;
+}
+
+//
+// W_HashWadFiles
+// Fills in the digest of every file seen in the
+// directory, reusing the stored digest where the
+// file hasn't changed
+//
+
+static void W_HashWadFiles(void) {
+    SDL_Thread *threads[WADSUMS_MAXTHREADS];
+    struct stat st;
+    dboolean dirty;
+    int numthreads;
+    int pending;
+    int i;
+    int j;
+
+    W_LoadWadSums();
+
+    pending = 0;
+
+    for(i = 0; i < numsumfiles; i++) {
+        sumfile_t *sf = &sumfiles[i];
+
+        if(stat(sf->wadfile->path, &st) == 0) {
+            sf->mtime = (unsigned int)st.st_mtime;
+        }
+
+        for(j = 0; j < numsumentries; j++) {
+            sumentry_t *entry = &sumentries[j];
+
+            if(entry->length == sf->wadfile->length && entry->mtime == sf->mtime &&
+                    !dstrcmp(entry->path, sf->wadfile->path)) {
+                dmemcpy(sf->digest, entry->digest, sizeof(md5_digest_t));
+                sf->hashed = true;
+                break;
+            }
+        }
+
+        if(!sf->hashed) {
+            pending++;
+        }
+    }
+
+    dirty = (pending > 0);
+
+    // entries for files not loaded now are kept if the file
+    // is still there as it was, and dropped otherwise
+    for(i = 0; i < numsumentries; i++) {
+        sumentry_t *entry = &sumentries[i];
+
+        for(j = 0; j < numsumfiles; j++) {
+            if(!dstrcmp(entry->path, sumfiles[j].wadfile->path)) {
+                break;
+            }
+        }
+
+        if(j == numsumfiles && stat(entry->path, &st) == 0 &&
+                (unsigned int)st.st_size == entry->length &&
+                (unsigned int)st.st_mtime == entry->mtime) {
+            entry->keep = true;
+        }
+        else if(j == numsumfiles || !sumfiles[j].hashed) {
+            dirty = true;
+        }
+    }
+
+    if(pending > 0) {
+        sumlock = SDL_CreateMutex();
+        nextsumfile = 0;
+
+        // the calling thread always takes part, so a
+        // failed thread creation only costs time
+        numthreads = 0;
+
+        for(i = 1; i < pending && i < WADSUMS_MAXTHREADS; i++) {
+            if((threads[numthreads] = SDL_CreateThread(W_WadSumThread, "WadSum", NULL))) {
+                numthreads++;
+            }
+        }
+
+        W_WadSumThread(NULL);
+
+        for(i = 0; i < numthreads; i++) {
+            SDL_WaitThread(threads[i], NULL);
+        }
+
+        SDL_DestroyMutex(sumlock);
+        sumlock = NULL;
+
+        for(i = 0; i < numsumfiles; i++) {
+            if(!sumfiles[i].hashed) {
+                I_Error("W_Checksum: Couldn't read %s", sumfiles[i].wadfile->path);
+            }
+        }
+    }
+
+    if(dirty) {
+        W_SaveWadSums();
+    }
+
+    for(i = 0; i < numsumentries; i++) {
+        free(sumentries[i].path);
+    }
+
+    free(sumentries);
+    sumentries = NULL;
+    numsumentries = 0;
+}
+
+//
+// W_Checksum
+//
+
+void W_Checksum(md5_digest_t digest) {
+    md5_context_t md5_context;
+    int *filenums;
+    char buf[9];
+    int i;
+
+    if(wadchecksumvalid) {
+        dmemcpy(digest, wadchecksum, sizeof(md5_digest_t));
+        return;
+    }
+
+    numsumfiles = 0;
+
+    filenums = malloc(numlumps * sizeof(int));
+
+    for(i = 0; i < numlumps; ++i) {
+        if(i > 0 && lumpinfo[i].wadfile == lumpinfo[i - 1].wadfile) {
+            filenums[i] = filenums[i - 1];
+        }
+        else {
+            filenums[i] = W_GetSumFile(lumpinfo[i].wadfile);
+        }
+    }
+
+    W_HashWadFiles();
+
+    MD5_Init(&md5_context);
+
+    for(i = 0; i < numsumfiles; ++i) {
+        MD5_Update(&md5_context, sumfiles[i].digest, sizeof(md5_digest_t));
+    }
+
+    // Go through each entry in the WAD directory, adding information
+    // about each entry to the MD5 hash.
+
+    for(i = 0; i < numlumps; ++i) {
+        dmemcpy(buf, lumpinfo[i].name, 8);
+        buf[8] = '\0';
+
+        MD5_UpdateString(&md5_context, buf);
+        MD5_UpdateInt32(&md5_context, filenums[i]);
+        MD5_UpdateInt32(&md5_context, lumpinfo[i].position);
+        MD5_UpdateInt32(&md5_context, lumpinfo[i].size);
+    }
+
+    MD5_Final(wadchecksum, &md5_context);
+
+    free(filenums);
+
+    wadchecksumvalid = true;
+    dmemcpy(digest, wadchecksum, sizeof(md5_digest_t));
+}
@@ -102,13 +102,51 @@ wad_file_class_t stdc_wad_file = {
     W_StdC_Read,
 };
 
-static wad_file_class_t *wad_file_classes = &stdc_wad_file;
+#ifndef _WIN32
+extern wad_file_class_t posix_wad_file;
+#endif
+
+static wad_file_class_t *wad_file_classes[] = {
+#ifndef _WIN32
+    &posix_wad_file,
+#endif
+    &stdc_wad_file,
+};
 
 wad_file_t *W_OpenFile(char *path) {
-    return stdc_wad_file.OpenFile(path);
+    wad_file_t *result;
+    int i;
+
+    // -nommap disables the memory mapped backend and reads every lump
+    // through stdio instead
+
+    if(M_CheckParm("-nommap")) {
+        result = stdc_wad_file.OpenFile(path);
+    }
+    else {
+        // Try each file class in turn; the first one that succeeds wins.
+        // Classes that can't map a file just fail and we fall through to stdio.
+
+        result = NULL;
+
+        for(i = 0; i < sizeof(wad_file_classes) / sizeof(*wad_file_classes); ++i) {
+            result = wad_file_classes[i]->OpenFile(path);
+
+            if(result != NULL) {
+                break;
+            }
+        }
+    }
+
+    if(result != NULL) {
+        result->path = Z_Strdup(path, PU_STATIC, 0);
+    }
+
+    return result;
 }
 
 void W_CloseFile(wad_file_t *wad) {
+    Z_Free(wad->path);
     wad->file_class->CloseFile(wad);
 }
 
@@ -60,6 +60,10 @@ struct _wad_file_s {
     // Length of the file, in bytes.
 
     unsigned int length;
+
+    // Path the file was opened from.
+
+    char *path;
 };
 
 // Open the specified file. Returns a pointer to a new wad_file_t
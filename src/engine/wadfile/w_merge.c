@@ -30,6 +30,9 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+
+#include "SDL.h"
 
 #include "doomdef.h"
 #include "i_system.h"
@@ -51,14 +54,21 @@ typedef enum {
 typedef struct {
     lumpinfo_t *lumps;
     int numlumps;
+
+    // name lookup, built on first search
+    int *hash;
+    int *next;
 } searchlist_t;
 
 typedef struct {
     char sprname[4];
     char frame;
     lumpinfo_t *angle_lumps[8];
+    int next;
 } sprite_frame_t;
 
+#define SPRITE_HASHSIZE 1024
+
 static searchlist_t iwad;
 static searchlist_t iwad_sprites;
 static searchlist_t iwad_textures;
@@ -75,16 +85,63 @@ static searchlist_t pwad_sounds;
 static sprite_frame_t *sprite_frames;
 static int num_sprite_frames;
 static int sprite_frames_alloced;
+static int sprite_frame_hash[SPRITE_HASHSIZE];
+
+// Point a list at a range of lumps, dropping any lookup
+// built for what it pointed at before
+
+static void InitList(searchlist_t *list, lumpinfo_t *lumps, int numlumps) {
+    if(list->hash != NULL) {
+        Z_Free(list->hash);
+        Z_Free(list->next);
+        list->hash = NULL;
+        list->next = NULL;
+    }
+
+    list->lumps = lumps;
+    list->numlumps = numlumps;
+}
+
+// Hash the names of every lump in a list. Chains are built
+// back to front so the first lump with a name is found first
+
+static void HashList(searchlist_t *list) {
+    int size;
+    int h;
+    int i;
+
+    size = list->numlumps ? list->numlumps : 1;
+
+    list->hash = Z_Malloc(sizeof(int) * size, PU_STATIC, NULL);
+    list->next = Z_Malloc(sizeof(int) * size, PU_STATIC, NULL);
+
+    for(i = 0; i < size; ++i) {
+        list->hash[i] = -1;
+    }
+
+    for(i = list->numlumps - 1; i >= 0; --i) {
+        h = W_HashLumpName(list->lumps[i].name) % size;
+        list->next[i] = list->hash[h];
+        list->hash[h] = i;
+    }
+}
 
 // Search in a list to find a lump with a particular name
-// Linear search (slow!)
 //
 // Returns -1 if not found
 
 static int FindInList(searchlist_t *list, char *name) {
     int i;
 
-    for(i = 0; i < list->numlumps; ++i) {
+    if(list->numlumps <= 0) {
+        return -1;
+    }
+
+    if(list->hash == NULL) {
+        HashList(list);
+    }
+
+    for(i = list->hash[W_HashLumpName(name) % list->numlumps]; i != -1; i = list->next[i]) {
         if(!strncasecmp(list->lumps[i].name, name, 8)) {
             return i;
         }
@@ -98,7 +155,7 @@ static dboolean SetupList(searchlist_t *list, searchlist_t *src_list,
                           char *startname2, char *endname2) {
     int startlump, endlump;
 
-    list->numlumps = 0;
+    InitList(list, NULL, 0);
     startlump = FindInList(src_list, startname);
 
     if(startname2 != NULL && startlump < 0) {
@@ -113,8 +170,7 @@ static dboolean SetupList(searchlist_t *list, searchlist_t *src_list,
         }
 
         if(endlump > startlump) {
-            list->lumps = src_list->lumps + startlump + 1;
-            list->numlumps = endlump - startlump - 1;
+            InitList(list, src_list->lumps + startlump + 1, endlump - startlump - 1);
             return true;
         }
     }
@@ -154,6 +210,8 @@ static void SetupLists(void) {
 // Initialise the replace list
 
 static void InitSpriteList(void) {
+    int i;
+
     if(sprite_frames == NULL) {
         sprite_frames_alloced = 128;
         sprite_frames = Z_Malloc(sizeof(*sprite_frames) * sprite_frames_alloced,
@@ -161,17 +219,39 @@ static void InitSpriteList(void) {
     }
 
     num_sprite_frames = 0;
+
+    for(i = 0; i < SPRITE_HASHSIZE; ++i) {
+        sprite_frame_hash[i] = -1;
+    }
+}
+
+// Hash a sprite name and frame
+
+static int SpriteFrameHash(char *name, int frame) {
+    unsigned int hash;
+    int i;
+
+    hash = frame;
+
+    for(i = 0; i < 4 && name[i] != '\0'; ++i) {
+        hash = (hash * 31) + toupper((int)name[i]);
+    }
+
+    return hash % SPRITE_HASHSIZE;
 }
 
 // Find a sprite frame
 
 static sprite_frame_t *FindSpriteFrame(char *name, int frame) {
     sprite_frame_t *result;
+    int hash;
     int i;
 
     // Search the list and try to find the frame
 
-    for(i = 0; i < num_sprite_frames; ++i) {
+    hash = SpriteFrameHash(name, frame);
+
+    for(i = sprite_frame_hash[hash]; i != -1; i = sprite_frames[i].next) {
         sprite_frame_t *cur = &sprite_frames[i];
 
         if(!strncasecmp(cur->sprname, name, 4) && cur->frame == frame) {
@@ -205,6 +285,9 @@ static sprite_frame_t *FindSpriteFrame(char *name, int frame) {
         result->angle_lumps[i] = NULL;
     }
 
+    result->next = sprite_frame_hash[hash];
+    sprite_frame_hash[hash] = num_sprite_frames;
+
     ++num_sprite_frames;
 
     return result;
@@ -613,8 +696,11 @@ void W_PrintDirectory(void) {
 
 void W_MergeFile(char *filename) {
     int old_numlumps;
+    int pwadlumps;
+    int starttime;
 
     old_numlumps = numlumps;
+    starttime = SDL_GetTicks();
 
     // Load PWAD
 
@@ -624,11 +710,9 @@ void W_MergeFile(char *filename) {
 
     // iwad is at the start, pwad was appended to the end
 
-    iwad.lumps = lumpinfo;
-    iwad.numlumps = old_numlumps;
-
-    pwad.lumps = lumpinfo + old_numlumps;
-    pwad.numlumps = numlumps - old_numlumps;
+    InitList(&iwad, lumpinfo, old_numlumps);
+    InitList(&pwad, lumpinfo + old_numlumps, numlumps - old_numlumps);
+    pwadlumps = pwad.numlumps;
 
     // Setup sprite/flat lists
 
@@ -641,6 +725,22 @@ void W_MergeFile(char *filename) {
     // Perform the merge
 
     DoMerge();
+
+    // lists point into the old lumpinfo, which DoMerge freed
+
+    InitList(&iwad, NULL, 0);
+    InitList(&pwad, NULL, 0);
+    InitList(&iwad_textures, NULL, 0);
+    InitList(&iwad_sprites, NULL, 0);
+    InitList(&iwad_gfx, NULL, 0);
+    InitList(&iwad_sounds, NULL, 0);
+    InitList(&pwad_textures, NULL, 0);
+    InitList(&pwad_sprites, NULL, 0);
+    InitList(&pwad_gfx, NULL, 0);
+    InitList(&pwad_sounds, NULL, 0);
+
+    I_Printf("W_MergeFile: Merged %s (%i lumps, %i sprite frames) in %ims\n",
+             filename, pwadlumps, num_sprite_frames, (int)(SDL_GetTicks() - starttime));
 }
 
 
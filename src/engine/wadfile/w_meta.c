@@ -0,0 +1,459 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// Copyright(C) 2007-2012 Samuel Villarreal
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+//-----------------------------------------------------------------------------
+//
+// DESCRIPTION:
+//    Persistent cache of per-lump image metadata (dimensions and
+//    offsets). Every entry is keyed by an MD5 of the identity of the
+//    file the lump lives in (path, size and modification time) and the
+//    lump's directory entry, so editing a WAD simply turns its entries
+//    into misses. Entries are grouped by file on disk, and a file's
+//    entries are only dropped once it has changed or gone missing, so
+//    switching between sets of WADs keeps the cache for all of them.
+//
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "doomdef.h"
+#include "i_system.h"
+#include "md5.h"
+#include "w_wad.h"
+#include "w_meta.h"
+
+#define LUMPMETA_FILE       "lumpmeta.dat"
+#define LUMPMETA_ID         "LMC2"
+#define LUMPMETA_HASHSIZE   4096
+
+typedef struct {
+    md5_digest_t    key;
+    lumpmeta_t      meta;
+    int             file;
+    int             next;
+} metaentry_t;
+
+typedef struct {
+    char*           path;
+    unsigned int    length;
+    unsigned int    mtime;
+    wad_file_t*     wadfile;    // NULL until a loaded file matches it
+    dboolean        stale;
+    md5_context_t   context;
+} metafile_t;
+
+static metaentry_t* metaentries = NULL;
+static int          nummetaentries = 0;
+static int          maxmetaentries = 0;
+static int          metahash[LUMPMETA_HASHSIZE];
+
+static metafile_t*  metafiles = NULL;
+static int          nummetafiles = 0;
+
+static dboolean     metaloaded = false;
+static dboolean     metadirty = false;
+
+//
+// W_MetaHashKey
+//
+
+static int W_MetaHashKey(md5_digest_t key) {
+    return (key[0] | (key[1] << 8)) & (LUMPMETA_HASHSIZE - 1);
+}
+
+//
+// W_FindMetaEntry
+//
+
+static metaentry_t *W_FindMetaEntry(md5_digest_t key) {
+    int i;
+
+    for(i = metahash[W_MetaHashKey(key)]; i != -1; i = metaentries[i].next) {
+        if(!memcmp(metaentries[i].key, key, sizeof(md5_digest_t))) {
+            return &metaentries[i];
+        }
+    }
+
+    return NULL;
+}
+
+//
+// W_NewMetaEntry
+//
+
+static metaentry_t *W_NewMetaEntry(md5_digest_t key, int file) {
+    metaentry_t *entry;
+    int hash;
+
+    if(nummetaentries == maxmetaentries) {
+        maxmetaentries = maxmetaentries ? maxmetaentries * 2 : 1024;
+        metaentries = realloc(metaentries, maxmetaentries * sizeof(metaentry_t));
+
+        if(metaentries == NULL) {
+            I_Error("W_NewMetaEntry: Couldn't realloc metaentries");
+        }
+    }
+
+    hash = W_MetaHashKey(key);
+
+    entry = &metaentries[nummetaentries];
+    dmemcpy(entry->key, key, sizeof(md5_digest_t));
+    dmemset(&entry->meta, 0, sizeof(lumpmeta_t));
+    entry->file = file;
+    entry->next = metahash[hash];
+
+    metahash[hash] = nummetaentries++;
+
+    return entry;
+}
+
+//
+// W_AddMetaFile
+//
+
+static metafile_t *W_AddMetaFile(const char *path, unsigned int length, unsigned int mtime) {
+    metafile_t *mf;
+
+    metafiles = realloc(metafiles, (nummetafiles + 1) * sizeof(metafile_t));
+
+    if(metafiles == NULL) {
+        I_Error("W_AddMetaFile: Couldn't realloc metafiles");
+    }
+
+    mf = &metafiles[nummetafiles++];
+    dmemset(mf, 0, sizeof(metafile_t));
+
+    mf->path = malloc(dstrlen(path) + 1);
+    dstrcpy(mf->path, path);
+    mf->length = length;
+    mf->mtime = mtime;
+
+    return mf;
+}
+
+//
+// W_FileTime
+//
+
+static unsigned int W_FileTime(const char *path, unsigned int *length) {
+    struct stat st;
+
+    if(stat(path, &st) != 0) {
+        return 0;
+    }
+
+    if(length) {
+        *length = (unsigned int)st.st_size;
+    }
+
+    return (unsigned int)st.st_mtime;
+}
+
+//
+// W_LoadLumpMeta
+// Files that have changed since they were cached
+// are marked stale and their entries skipped
+//
+
+static void W_LoadLumpMeta(void) {
+    FILE *f;
+    char *path;
+    char id[4];
+    unsigned int length;
+    unsigned int mtime;
+    int numfiles;
+    int count;
+    int file;
+    int len;
+    int i;
+
+    metaloaded = true;
+
+    for(i = 0; i < LUMPMETA_HASHSIZE; i++) {
+        metahash[i] = -1;
+    }
+
+    if(!(path = I_GetUserFile(LUMPMETA_FILE))) {
+        return;
+    }
+
+    f = fopen(path, "rb");
+    free(path);
+
+    if(!f) {
+        return;
+    }
+
+    if(fread(id, 1, 4, f) != 4 || dstrncmp(id, LUMPMETA_ID, 4) ||
+            fread(&numfiles, sizeof(int), 1, f) != 1 || numfiles < 0 || numfiles > 0x10000) {
+        fclose(f);
+        return;
+    }
+
+    for(i = 0; i < numfiles; i++) {
+        metafile_t *mf;
+        char *name;
+
+        if(fread(&len, sizeof(int), 1, f) != 1 || len <= 0 || len > 4096) {
+            break;
+        }
+
+        name = malloc(len + 1);
+
+        if(fread(name, 1, len, f) != (size_t)len ||
+                fread(&length, sizeof(int), 1, f) != 1 ||
+                fread(&mtime, sizeof(int), 1, f) != 1) {
+            free(name);
+            break;
+        }
+
+        name[len] = 0;
+
+        mf = W_AddMetaFile(name, length, mtime);
+        free(name);
+
+        length = 0;
+
+        if(W_FileTime(mf->path, &length) != mf->mtime || length != mf->length) {
+            mf->stale = true;
+            metadirty = true;
+        }
+    }
+
+    if(i != numfiles || fread(&count, sizeof(int), 1, f) != 1) {
+        fclose(f);
+        return;
+    }
+
+    for(i = 0; i < count; i++) {
+        md5_digest_t key;
+        lumpmeta_t meta;
+
+        if(fread(&file, sizeof(int), 1, f) != 1 ||
+                fread(key, sizeof(md5_digest_t), 1, f) != 1 ||
+                fread(&meta, sizeof(lumpmeta_t), 1, f) != 1) {
+            break;
+        }
+
+        if(file < 0 || file >= numfiles || metafiles[file].stale) {
+            continue;
+        }
+
+        W_NewMetaEntry(key, file)->meta = meta;
+    }
+
+    fclose(f);
+}
+
+//
+// W_GetMetaFile
+// Returns the file record for a loaded WAD, reusing the one read
+// from disk when nothing about the file has changed. Its context
+// is primed with the identity of the file, so that only the
+// directory entry needs hashing per lump
+//
+
+static int W_GetMetaFile(wad_file_t *wadfile) {
+    metafile_t *mf;
+    unsigned int mtime;
+    int i;
+
+    for(i = 0; i < nummetafiles; i++) {
+        if(metafiles[i].wadfile == wadfile) {
+            return i;
+        }
+    }
+
+    mtime = W_FileTime(wadfile->path, NULL);
+
+    for(i = 0; i < nummetafiles; i++) {
+        mf = &metafiles[i];
+
+        if(!mf->wadfile && !mf->stale && mf->length == wadfile->length &&
+                mf->mtime == mtime && !dstrcmp(mf->path, wadfile->path)) {
+            break;
+        }
+    }
+
+    if(i == nummetafiles) {
+        W_AddMetaFile(wadfile->path, wadfile->length, mtime);
+    }
+
+    mf = &metafiles[i];
+    mf->wadfile = wadfile;
+
+    MD5_Init(&mf->context);
+    MD5_UpdateString(&mf->context, wadfile->path);
+    MD5_UpdateInt32(&mf->context, wadfile->length);
+
+    if(mtime) {
+        MD5_UpdateInt32(&mf->context, mtime);
+    }
+
+    return i;
+}
+
+//
+// W_LumpMetaKey
+//
+
+static int W_LumpMetaKey(int lump, md5_digest_t key) {
+    md5_context_t md5_context;
+    lumpinfo_t *l;
+    char name[9];
+    int file;
+
+    l = &lumpinfo[lump];
+
+    file = W_GetMetaFile(l->wadfile);
+    md5_context = metafiles[file].context;
+
+    dmemcpy(name, l->name, 8);
+    name[8] = 0;
+
+    MD5_UpdateString(&md5_context, name);
+    MD5_UpdateInt32(&md5_context, l->position);
+    MD5_UpdateInt32(&md5_context, l->size);
+    MD5_Final(key, &md5_context);
+
+    return file;
+}
+
+//
+// W_GetLumpMeta
+//
+
+dboolean W_GetLumpMeta(int lump, lumpmeta_t *meta) {
+    md5_digest_t key;
+    metaentry_t *entry;
+
+    if(!metaloaded) {
+        W_LoadLumpMeta();
+    }
+
+    W_LumpMetaKey(lump, key);
+
+    if(!(entry = W_FindMetaEntry(key))) {
+        return false;
+    }
+
+    *meta = entry->meta;
+
+    return true;
+}
+
+//
+// W_SetLumpMeta
+//
+
+void W_SetLumpMeta(int lump, lumpmeta_t *meta) {
+    md5_digest_t key;
+    metaentry_t *entry;
+    int file;
+
+    if(!metaloaded) {
+        W_LoadLumpMeta();
+    }
+
+    file = W_LumpMetaKey(lump, key);
+
+    if(!(entry = W_FindMetaEntry(key))) {
+        entry = W_NewMetaEntry(key, file);
+    }
+
+    entry->meta = *meta;
+
+    metadirty = true;
+}
+
+//
+// W_SaveLumpMeta
+// Everything still valid is written back, whether or
+// not its WAD was loaded this session. Stale files and
+// files left without entries are dropped
+//
+
+void W_SaveLumpMeta(void) {
+    FILE *f;
+    char *path;
+    int *remap;
+    int numfiles;
+    int len;
+    int i;
+
+    if(!metadirty) {
+        return;
+    }
+
+    if(!(path = I_GetUserFile(LUMPMETA_FILE))) {
+        return;
+    }
+
+    f = fopen(path, "wb");
+    free(path);
+
+    if(!f) {
+        return;
+    }
+
+    remap = calloc(nummetafiles + 1, sizeof(int));
+
+    for(i = 0; i < nummetaentries; i++) {
+        remap[metaentries[i].file] = 1;
+    }
+
+    numfiles = 0;
+    for(i = 0; i < nummetafiles; i++) {
+        remap[i] = remap[i] ? numfiles++ : -1;
+    }
+
+    fwrite(LUMPMETA_ID, 1, 4, f);
+    fwrite(&numfiles, sizeof(int), 1, f);
+
+    for(i = 0; i < nummetafiles; i++) {
+        metafile_t *mf = &metafiles[i];
+
+        if(remap[i] == -1) {
+            continue;
+        }
+
+        len = dstrlen(mf->path);
+
+        fwrite(&len, sizeof(int), 1, f);
+        fwrite(mf->path, 1, len, f);
+        fwrite(&mf->length, sizeof(int), 1, f);
+        fwrite(&mf->mtime, sizeof(int), 1, f);
+    }
+
+    fwrite(&nummetaentries, sizeof(int), 1, f);
+
+    for(i = 0; i < nummetaentries; i++) {
+        fwrite(&remap[metaentries[i].file], sizeof(int), 1, f);
+        fwrite(metaentries[i].key, sizeof(md5_digest_t), 1, f);
+        fwrite(&metaentries[i].meta, sizeof(lumpmeta_t), 1, f);
+    }
+
+    fclose(f);
+    free(remap);
+
+    metadirty = false;
+}
@@ -0,0 +1,51 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// Copyright(C) 2007-2012 Samuel Villarreal
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __W_META__
+#define __W_META__
+
+#include "doomtype.h"
+
+//
+// Image metadata remembered across runs so that startup doesn't
+// need to decode every texture just to learn its size.
+//
+typedef struct {
+    int width;
+    int height;
+    int offset[2];
+} lumpmeta_t;
+
+// Looks up the cached metadata for a lump. Returns false on a miss,
+// which includes the lump or the file it lives in having changed.
+
+dboolean W_GetLumpMeta(int lump, lumpmeta_t *meta);
+
+// Records the metadata for a lump.
+
+void W_SetLumpMeta(int lump, lumpmeta_t *meta);
+
+// Writes the cache back to disk if anything was added to it.
+
+void W_SaveLumpMeta(void);
+
+#endif
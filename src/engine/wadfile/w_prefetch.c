@@ -0,0 +1,609 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// Copyright(C) 2007-2012 Samuel Villarreal
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+//-----------------------------------------------------------------------------
+//
+// DESCRIPTION:
+//    Background lump reader. While the intermission is up, a worker
+//    thread reads the next map and the textures its sectors and
+//    sidedefs reference into a staging list, which W_CacheLumpNum
+//    checks before going to disk.
+//
+//    For memory mapped files there is nothing to copy; the worker just
+//    touches every page of the lump so it is resident by the time the
+//    main thread asks for it.
+//
+//    The worker never allocates from the zone. Staged data lives in
+//    plain malloc'd buffers and is copied into the zone by the main
+//    thread when taken. Whatever the level didn't take is freed once
+//    it has loaded.
+//
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+
+#include "SDL.h"
+
+#include "doomdef.h"
+#include "doomdata.h"
+#include "i_swap.h"
+#include "i_system.h"
+#include "w_wad.h"
+#include "w_prefetch.h"
+
+typedef enum {
+    PF_QUEUED,
+    PF_READING,
+    PF_READY
+} pfstate_t;
+
+typedef struct {
+    int         lump;
+    int         serial;
+    pfstate_t   state;
+    dboolean    maplump;    // parse for textures once read
+    byte*       data;       // NULL for mapped files
+} prefetch_t;
+
+typedef struct {
+    wad_file_t* wadfile;
+    FILE*       fstream;
+} pffile_t;
+
+static SDL_Thread*  prefetchthread = NULL;
+static SDL_mutex*   prefetchlock = NULL;
+static SDL_cond*    prefetchcond = NULL;
+
+static prefetch_t*  prefetchlist = NULL;
+static int          numprefetch = 0;
+static int          maxprefetch = 0;
+static int          prefetchserial = 0;
+static int          prefetchmap = -1;
+static dboolean     prefetchquit = false;
+
+// lump -> prefetchlist index + 1, 0 when not staged
+static int*         prefetchindex = NULL;
+
+// mirrors numprefetch so cache misses can skip the lock
+static SDL_atomic_t prefetchcount;
+
+// texture name hash -> texture index + 1, same mapping P_GetTextureHashKey uses
+static word*        texturehash = NULL;
+static int          texturestart = -1;
+static int          texturecount = 0;
+
+// worker-side file handles for files that aren't mapped
+static pffile_t*    pffiles = NULL;
+static int          numpffiles = 0;
+
+//
+// W_FindPrefetch
+// Must hold prefetchlock
+//
+
+static prefetch_t *W_FindPrefetch(int lump) {
+    if(!prefetchindex[lump]) {
+        return NULL;
+    }
+
+    return &prefetchlist[prefetchindex[lump] - 1];
+}
+
+//
+// W_QueuePrefetch
+// Must hold prefetchlock
+//
+
+static void W_QueuePrefetch(int lump, dboolean maplump) {
+    prefetch_t *pf;
+
+    if(lump < 0 || lump >= numlumps || W_FindPrefetch(lump)) {
+        return;
+    }
+
+    if(numprefetch == maxprefetch) {
+        maxprefetch = maxprefetch ? maxprefetch * 2 : 256;
+        prefetchlist = realloc(prefetchlist, maxprefetch * sizeof(prefetch_t));
+
+        if(prefetchlist == NULL) {
+            I_Error("W_QueuePrefetch: Couldn't realloc prefetchlist");
+        }
+    }
+
+    pf = &prefetchlist[numprefetch++];
+    pf->lump = lump;
+    pf->serial = ++prefetchserial;
+    pf->state = PF_QUEUED;
+    pf->maplump = maplump;
+    pf->data = NULL;
+
+    prefetchindex[lump] = numprefetch;
+    SDL_AtomicSet(&prefetchcount, numprefetch);
+
+    SDL_CondBroadcast(prefetchcond);
+}
+
+//
+// W_RemovePrefetch
+// Must hold prefetchlock. Does not free the data
+//
+
+static void W_RemovePrefetch(prefetch_t *pf) {
+    prefetchindex[pf->lump] = 0;
+    *pf = prefetchlist[--numprefetch];
+
+    if(pf != &prefetchlist[numprefetch]) {
+        prefetchindex[pf->lump] = (int)(pf - prefetchlist) + 1;
+    }
+
+    SDL_AtomicSet(&prefetchcount, numprefetch);
+}
+
+//
+// W_ClearPrefetch
+// Drops everything staged. A lump the worker is still reading
+// is no longer found when it finishes and gets thrown away then
+//
+
+static void W_ClearPrefetch(void) {
+    int i;
+
+    for(i = 0; i < numprefetch; i++) {
+        if(prefetchlist[i].data) {
+            free(prefetchlist[i].data);
+        }
+
+        prefetchindex[prefetchlist[i].lump] = 0;
+    }
+
+    numprefetch = 0;
+    SDL_AtomicSet(&prefetchcount, 0);
+}
+
+//
+// W_GetPrefetchFile
+// Worker side only
+//
+
+static FILE *W_GetPrefetchFile(wad_file_t *wadfile) {
+    pffile_t *newfiles;
+    int i;
+
+    for(i = 0; i < numpffiles; i++) {
+        if(pffiles[i].wadfile == wadfile) {
+            return pffiles[i].fstream;
+        }
+    }
+
+    // no I_Error from here, the main thread just reads it itself
+    if(!(newfiles = realloc(pffiles, (numpffiles + 1) * sizeof(pffile_t)))) {
+        return NULL;
+    }
+
+    pffiles = newfiles;
+    pffiles[numpffiles].wadfile = wadfile;
+    pffiles[numpffiles].fstream = fopen(wadfile->path, "rb");
+
+    return pffiles[numpffiles++].fstream;
+}
+
+//
+// W_PrefetchInflate
+//
+
+static byte *W_PrefetchInflate(lumpinfo_t *l) {
+    byte *cdata = NULL;
+    byte *data = NULL;
+    int csize;
+    FILE *f = NULL;
+
+    if(l->wadfile->mapped) {
+        if((unsigned int)(l->position + 4) > l->wadfile->length) {
+            return NULL;
+        }
+
+        csize = LONG(*(int*)(l->wadfile->mapped + l->position));
+    }
+    else {
+        if(!(f = W_GetPrefetchFile(l->wadfile)) ||
+                fseek(f, l->position, SEEK_SET) || fread(&csize, 4, 1, f) != 1) {
+            return NULL;
+        }
+
+        csize = LONG(csize);
+    }
+
+    if(csize <= 0 || (unsigned int)(l->position + 4 + csize) > l->wadfile->length) {
+        return NULL;
+    }
+
+    if(l->wadfile->mapped) {
+        cdata = l->wadfile->mapped + l->position + 4;
+    }
+    else if(!(cdata = malloc(csize)) || fread(cdata, 1, csize, f) != (size_t)csize) {
+        free(cdata);
+        return NULL;
+    }
+
+    // leave anything broken to W_ReadLump, which will report it
+    if((data = malloc(l->size)) && !W_InflateLump(cdata, csize, data, l->size)) {
+        free(data);
+        data = NULL;
+    }
+
+    if(!l->wadfile->mapped) {
+        free(cdata);
+    }
+
+    return data;
+}
+
+//
+// W_PrefetchRead
+// Worker side only. lumpinfo doesn't change after W_Init
+// so it's safe to look at from here
+//
+
+static byte *W_PrefetchRead(int lump) {
+    lumpinfo_t *l;
+    byte *data;
+    FILE *f;
+
+    l = &lumpinfo[lump];
+
+    if(l->size <= 0) {
+        return NULL;
+    }
+
+    // inflating is the expensive part of a compressed
+    // lump, so those always get staged
+    if(l->compressed) {
+        return W_PrefetchInflate(l);
+    }
+
+    if(l->wadfile->mapped) {
+        volatile byte touch = 0;
+        int i;
+
+        // fault the pages in, nothing else to do
+        for(i = 0; i < l->size; i += 4096) {
+            touch += l->wadfile->mapped[l->position + i];
+        }
+
+        return NULL;
+    }
+
+    if(!(f = W_GetPrefetchFile(l->wadfile))) {
+        return NULL;
+    }
+
+    if(!(data = malloc(l->size))) {
+        return NULL;
+    }
+
+    if(fseek(f, l->position, SEEK_SET) ||
+            fread(data, 1, l->size, f) != (size_t)l->size) {
+        free(data);
+        return NULL;
+    }
+
+    return data;
+}
+
+//
+// W_PrefetchTexture
+// Must hold prefetchlock
+//
+
+static void W_PrefetchTexture(word hash) {
+    int tex;
+
+    if(!texturehash || !(tex = texturehash[hash])) {
+        return;
+    }
+
+    W_QueuePrefetch(texturestart + tex - 1, false);
+}
+
+//
+// W_PrefetchMapTextures
+// Must hold prefetchlock. Walks the sectors and sidedefs of
+// a map lump and queues every texture they reference
+//
+
+static void W_PrefetchMapTextures(int lump, byte *data) {
+    wadinfo_t *header;
+    filelump_t *dir;
+    int length;
+    int count;
+    int i;
+
+    if(!data) {
+        if(!lumpinfo[lump].wadfile->mapped) {
+            return;
+        }
+
+        data = lumpinfo[lump].wadfile->mapped + lumpinfo[lump].position;
+    }
+
+    length = lumpinfo[lump].size;
+    header = (wadinfo_t*)data;
+
+    if(length < sizeof(wadinfo_t) || LONG(header->numlumps) <= ML_SIDEDEFS ||
+            LONG(header->numlumps) <= ML_SECTORS || LONG(header->infotableofs) < 0 ||
+            LONG(header->infotableofs) + LONG(header->numlumps) * (int)sizeof(filelump_t) > length) {
+        return;
+    }
+
+    dir = (filelump_t*)(data + LONG(header->infotableofs));
+
+    if(LONG(dir[ML_SECTORS].filepos) >= 0 &&
+            LONG(dir[ML_SECTORS].filepos) + LONG(dir[ML_SECTORS].size) <= length) {
+        mapsector_t *ms = (mapsector_t*)(data + LONG(dir[ML_SECTORS].filepos));
+
+        count = LONG(dir[ML_SECTORS].size) / sizeof(mapsector_t);
+
+        for(i = 0; i < count; i++, ms++) {
+            W_PrefetchTexture(SHORT(ms->floorpic));
+            W_PrefetchTexture(SHORT(ms->ceilingpic));
+        }
+    }
+
+    if(LONG(dir[ML_SIDEDEFS].filepos) >= 0 &&
+            LONG(dir[ML_SIDEDEFS].filepos) + LONG(dir[ML_SIDEDEFS].size) <= length) {
+        mapsidedef_t *msd = (mapsidedef_t*)(data + LONG(dir[ML_SIDEDEFS].filepos));
+
+        count = LONG(dir[ML_SIDEDEFS].size) / sizeof(mapsidedef_t);
+
+        for(i = 0; i < count; i++, msd++) {
+            W_PrefetchTexture(SHORT(msd->toptexture));
+            W_PrefetchTexture(SHORT(msd->bottomtexture));
+            W_PrefetchTexture(SHORT(msd->midtexture));
+        }
+    }
+}
+
+//
+// W_PrefetchThread
+//
+
+static int SDLCALL W_PrefetchThread(void *unused) {
+    SDL_LockMutex(prefetchlock);
+
+    while(!prefetchquit) {
+        prefetch_t *pf = NULL;
+        dboolean maplump;
+        byte *data;
+        int serial;
+        int lump;
+        int i;
+
+        for(i = 0; i < numprefetch; i++) {
+            if(prefetchlist[i].state == PF_QUEUED) {
+                pf = &prefetchlist[i];
+                break;
+            }
+        }
+
+        if(pf == NULL) {
+            SDL_CondWait(prefetchcond, prefetchlock);
+            continue;
+        }
+
+        pf->state = PF_READING;
+        lump = pf->lump;
+        serial = pf->serial;
+        maplump = pf->maplump;
+
+        SDL_UnlockMutex(prefetchlock);
+        data = W_PrefetchRead(lump);
+        SDL_LockMutex(prefetchlock);
+
+        // list may have been cleared or reshuffled while reading
+        pf = W_FindPrefetch(lump);
+
+        if(pf == NULL || pf->serial != serial) {
+            if(data) {
+                free(data);
+            }
+            continue;
+        }
+
+        pf->data = data;
+        pf->state = PF_READY;
+
+        if(maplump) {
+            W_PrefetchMapTextures(lump, data);
+        }
+
+        SDL_CondBroadcast(prefetchcond);
+    }
+
+    SDL_UnlockMutex(prefetchlock);
+
+    return 0;
+}
+
+//
+// W_InitPrefetch
+//
+
+static void W_InitPrefetch(void) {
+    int start;
+    int end;
+    int i;
+
+    prefetchlock = SDL_CreateMutex();
+    prefetchcond = SDL_CreateCond();
+    prefetchindex = calloc(numlumps, sizeof(int));
+    SDL_AtomicSet(&prefetchcount, 0);
+
+    start = W_CheckNumForName("T_START");
+    end = W_CheckNumForName("T_END");
+
+    if(start != -1 && end > start) {
+        texturestart = start + 1;
+        texturecount = end - texturestart;
+        texturehash = calloc(65536, sizeof(word));
+
+        // walk backwards so the first texture with a given hash wins,
+        // same as P_GetTextureHashKey
+        for(i = texturecount - 1; i >= 0; i--) {
+            texturehash[W_HashLumpName(lumpinfo[texturestart + i].name) % 65536] = i + 1;
+        }
+    }
+
+    prefetchthread = SDL_CreateThread(W_PrefetchThread, "WadPrefetch", NULL);
+
+    if(prefetchthread == NULL) {
+        I_Printf("W_InitPrefetch: Couldn't create prefetch thread\n");
+    }
+}
+
+//
+// W_PrefetchMap
+//
+
+void W_PrefetchMap(int map) {
+    char name8[9];
+    int lump;
+    int i;
+
+    if(prefetchlock == NULL) {
+        W_InitPrefetch();
+    }
+
+    if(prefetchthread == NULL) {
+        return;
+    }
+
+    sprintf(name8, "MAP%02d", map);
+    name8[8] = 0;
+
+    if((lump = W_CheckNumForName(name8)) == -1) {
+        return;
+    }
+
+    SDL_LockMutex(prefetchlock);
+
+    if(prefetchmap != map) {
+        W_ClearPrefetch();
+        prefetchmap = map;
+    }
+
+    // standard doom map storage, the map lumps follow the marker
+    if(!((lump+1) >= numlumps) && !dstrncmp(lumpinfo[lump+1].name, "THINGS", 8)) {
+        for(i = ML_THINGS; i <= ML_MACROS && lump + i < numlumps; i++) {
+            W_QueuePrefetch(lump + i, false);
+        }
+    }
+    else {
+        W_QueuePrefetch(lump, true);
+    }
+
+    SDL_UnlockMutex(prefetchlock);
+}
+
+//
+// W_GetPrefetchedLump
+//
+
+dboolean W_GetPrefetchedLump(int lump, void *dest) {
+    prefetch_t *pf;
+    dboolean result;
+
+    if(prefetchthread == NULL || !SDL_AtomicGet(&prefetchcount)) {
+        return false;
+    }
+
+    SDL_LockMutex(prefetchlock);
+
+    // a lump that's halfway read is worth waiting for, one that's
+    // still queued is dropped and the caller reads it instead
+    while((pf = W_FindPrefetch(lump)) != NULL && pf->state == PF_READING) {
+        SDL_CondWait(prefetchcond, prefetchlock);
+    }
+
+    result = false;
+
+    if(pf != NULL) {
+        if(pf->state == PF_READY && pf->data) {
+            dmemcpy(dest, pf->data, lumpinfo[lump].size);
+            free(pf->data);
+            result = true;
+        }
+
+        W_RemovePrefetch(pf);
+    }
+
+    SDL_UnlockMutex(prefetchlock);
+
+    return result;
+}
+
+//
+// W_ReleasePrefetch
+//
+
+void W_ReleasePrefetch(void) {
+    if(prefetchthread == NULL) {
+        return;
+    }
+
+    SDL_LockMutex(prefetchlock);
+
+    W_ClearPrefetch();
+    prefetchmap = -1;
+
+    SDL_UnlockMutex(prefetchlock);
+}
+
+//
+// W_ShutdownPrefetch
+//
+
+void W_ShutdownPrefetch(void) {
+    int i;
+
+    if(prefetchthread == NULL) {
+        return;
+    }
+
+    SDL_LockMutex(prefetchlock);
+
+    W_ClearPrefetch();
+    prefetchquit = true;
+    SDL_CondBroadcast(prefetchcond);
+
+    SDL_UnlockMutex(prefetchlock);
+
+    SDL_WaitThread(prefetchthread, NULL);
+    prefetchthread = NULL;
+
+    for(i = 0; i < numpffiles; i++) {
+        if(pffiles[i].fstream) {
+            fclose(pffiles[i].fstream);
+        }
+    }
+
+    free(pffiles);
+    pffiles = NULL;
+    numpffiles = 0;
+}
@@ -0,0 +1,47 @@
+// Emacs style mode select   -*- C++ -*-
+//-----------------------------------------------------------------------------
+//
+// Copyright(C) 2007-2012 Samuel Villarreal
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+// 02111-1307, USA.
+//
+//-----------------------------------------------------------------------------
+
+#ifndef __W_PREFETCH__
+#define __W_PREFETCH__
+
+#include "doomtype.h"
+
+// Starts reading the given map and the textures it uses in the
+// background. Safe to call more than once for the same map.
+
+void W_PrefetchMap(int map);
+
+// Copies a staged lump into dest and releases it, waiting if the worker
+// is in the middle of reading it. Returns false if the lump isn't staged,
+// in which case the caller reads it itself.
+
+dboolean W_GetPrefetchedLump(int lump, void *dest);
+
+// Frees anything staged that the level didn't use.
+
+void W_ReleasePrefetch(void);
+
+// Stops the worker thread and closes its files.
+
+void W_ShutdownPrefetch(void);
+
+#endif
@@ -38,6 +38,7 @@
 #include <ctype.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <zlib.h>
 
 #ifdef _WIN32
 #include <io.h>
@@ -52,7 +53,7 @@
 #include "con_console.h"
 #include "m_misc.h"
 
-#include "md5.h"
+#include "w_prefetch.h"
 
 
 
@@ -65,31 +66,6 @@
 // GLOBALS
 //
 
-#ifdef _MSC_VER
-#pragma pack(push, 1)
-#endif
-
-//
-// TYPES
-//
-typedef struct {
-    // Should be "IWAD" or "PWAD".
-    char        identification[4];
-    int            numlumps;
-    int            infotableofs;
-} PACKEDATTR wadinfo_t;
-
-
-typedef struct {
-    int            filepos;
-    int            size;
-    char        name[8];
-} PACKEDATTR filelump_t;
-
-#ifdef _MSC_VER
-#pragma pack(pop)
-#endif
-
 #define MAX_MEMLUMPS    16
 
 // Location of each lump on disk.
@@ -225,7 +201,9 @@ void W_Init(void) {
         lump_p->position = LONG(filerover->filepos);
         lump_p->size = LONG(filerover->size);
         lump_p->cache = NULL;
+        lump_p->compressed = (filerover->name[0] & LUMP_COMPRESSED) != 0;
         dmemcpy(lump_p->name, filerover->name, 8);
+        lump_p->name[0] &= ~LUMP_COMPRESSED;
     }
 
     if(!numlumps) {
@@ -356,7 +334,9 @@ wad_file_t *W_AddFile(char *filename) {
         lump_p->position = LONG(filerover->filepos);
         lump_p->size = LONG(filerover->size);
         lump_p->cache = NULL;
+        lump_p->compressed = (filerover->name[0] & LUMP_COMPRESSED) != 0;
         dmemcpy(lump_p->name, filerover->name, 8);
+        lump_p->name[0] &= ~LUMP_COMPRESSED;
 
         ++lump_p;
         ++filerover;
@@ -374,6 +354,7 @@ static dboolean nonmaplump = false;
 filelump_t *mapLump;
 int numMapLumps;
 byte *mapLumpData = NULL;
+static int mapLumpNum = -1;
 
 //
 // W_CacheMapLump
@@ -395,6 +376,7 @@ void W_CacheMapLump(int map) {
     }
     else {
         mapLumpData = (byte*)W_CacheLumpNum(lump, PU_STATIC);
+        mapLumpNum = lump;
     }
 
     numMapLumps = ((wadinfo_t*)mapLumpData)->numlumps;
@@ -415,10 +397,11 @@ void W_FreeMapLump(void) {
     nonmaplump = false;
 
     if(mapLumpData) {
-        Z_Free(mapLumpData);
+        W_ReleaseLumpNum(mapLumpNum);
     }
 
     mapLumpData = NULL;
+    mapLumpNum = -1;
 }
 
 //
@@ -518,6 +501,60 @@ int W_LumpLength(int lump) {
     return lumpinfo[lump].size;
 }
 
+//
+// W_InflateLump
+// Safe to call from any thread
+//
+
+dboolean W_InflateLump(byte* src, int srclen, void* dest, int destlen) {
+    uLongf len = destlen;
+
+    if(uncompress(dest, &len, src, srclen) != Z_OK) {
+        return false;
+    }
+
+    return (len == (uLongf)destlen);
+}
+
+//
+// W_ReadCompressedLump
+//
+
+static void W_ReadCompressedLump(int lump, void *dest) {
+    lumpinfo_t *l;
+    byte *data;
+    int csize;
+
+    l = lumpinfo+lump;
+
+    if(W_Read(l->wadfile, l->position, &csize, 4) < 4) {
+        I_Error("W_ReadLump: couldn't read header of compressed lump %i", lump);
+    }
+
+    csize = LONG(csize);
+
+    if(csize < 0 || (unsigned int)(l->position + 4 + csize) > l->wadfile->length) {
+        I_Error("W_ReadLump: compressed lump %i runs past end of file", lump);
+    }
+
+    // inflate straight out of the mapping if there is one
+    if(l->wadfile->mapped) {
+        data = l->wadfile->mapped + l->position + 4;
+    }
+    else {
+        data = Z_Malloc(csize, PU_STATIC, 0);
+        W_Read(l->wadfile, l->position + 4, data, csize);
+    }
+
+    if(!W_InflateLump(data, csize, dest, l->size)) {
+        I_Error("W_ReadLump: failed to decompress lump %i", lump);
+    }
+
+    if(!l->wadfile->mapped) {
+        Z_Free(data);
+    }
+}
+
 //
 // W_ReadLump
 // Loads the lump into the given buffer,
@@ -536,6 +573,11 @@ void W_ReadLump(int lump, void *dest) {
 
     I_BeginRead();
 
+    if(l->compressed) {
+        W_ReadCompressedLump(lump, dest);
+        return;
+    }
+
     c = W_Read(l->wadfile, l->position, dest, l->size);
 
     if(c < l->size) {
@@ -556,15 +598,27 @@ void* W_CacheLumpNum(int lump, int tag) {
 
     l = &lumpinfo[lump];
 
+    // lumps from a memory mapped file are handed out straight from
+    // the mapping, there's nothing to read or keep in the zone
+    if(l->wadfile->mapped && !l->compressed) {
+        if((unsigned int)(l->position + l->size) > l->wadfile->length) {
+            I_Error("W_CacheLumpNum: lump %i runs past end of file", lump);
+        }
+
+        return l->wadfile->mapped + l->position;
+    }
+
     if(!l->cache) {    // read the lump in
         Z_Malloc(W_LumpLength(lump), tag, &l->cache);
-        W_ReadLump(lump, l->cache);
+
+        if(!W_GetPrefetchedLump(lump, l->cache)) {
+            W_ReadLump(lump, l->cache);
+        }
     }
     else {
-        // [d64] 'touch' static caches
-        if(tag == PU_STATIC) {
-            Z_Touch(l->cache);
-        }
+        // [d64] 'touch' caches, which also keeps
+        // PU_CACHE lumps at the recent end of the LRU
+        Z_Touch(l->cache);
 
         // avoid changing PU_STATIC data into PU_CACHE
         if(tag < Z_CheckTag(l->cache)) {
@@ -584,61 +638,59 @@ void* W_CacheLumpName(const char* name, int tag) {
 }
 
 //
-// W_Checksum
+// W_ReleaseLumpNum
+// Frees the cached copy of a lump. Mapped lumps never
+// get a cached copy, so this is a no-op for them.
 //
 
-static wad_file_t **open_wadfiles = NULL;
-static int num_open_wadfiles = 0;
-
-static int GetFileNumber(wad_file_t *handle) {
-    int i;
-    int result;
+void W_ReleaseLumpNum(int lump) {
+    lumpinfo_t *l;
 
-    for(i = 0; i < num_open_wadfiles; ++i) {
-        if(open_wadfiles[i] == handle) {
-            return i;
-        }
+    if(lump < 0 || lump >= numlumps) {
+        I_Error("W_ReleaseLumpNum: lump %i out of range", lump);
     }
 
-    // Not found in list.  This is a new file we haven't seen yet.
-    // Allocate another slot for this file.
-
-    open_wadfiles = realloc(open_wadfiles,
-                            sizeof(wad_file_t *) * (num_open_wadfiles + 1));
-    open_wadfiles[num_open_wadfiles] = handle;
-
-    result = num_open_wadfiles;
-    ++num_open_wadfiles;
+    l = &lumpinfo[lump];
 
-    return result;
+    if(l->cache) {
+        Z_Free(l->cache);
+    }
 }
 
-static void ChecksumAddLump(md5_context_t *md5_context, lumpinfo_t *lump) {
-    char buf[9];
-
-    strncpy(buf, lump->name, 8);
-    buf[8] = '\0';
+//
+// W_ReleaseLumpName
+//
 
-    MD5_UpdateString(md5_context, buf);
-    MD5_UpdateInt32(md5_context, GetFileNumber(lump->wadfile));
-    MD5_UpdateInt32(md5_context, lump->position);
-    MD5_UpdateInt32(md5_context, lump->size);
+void W_ReleaseLumpName(const char* name) {
+    W_ReleaseLumpNum(W_GetNumForName(name));
 }
 
-void W_Checksum(md5_digest_t digest) {
-    md5_context_t md5_context;
-    int i;
+//
+// W_UnlockLumpNum
+// Hands the cached copy of a lump over to PU_CACHE, where it
+// stays for the next W_CacheLumpNum until z_cachesize needs
+// the room. Lumps that are reread often should be unlocked
+// rather than released.
+//
 
-    MD5_Init(&md5_context);
+void W_UnlockLumpNum(int lump) {
+    lumpinfo_t *l;
 
-    num_open_wadfiles = 0;
+    if(lump < 0 || lump >= numlumps) {
+        I_Error("W_UnlockLumpNum: lump %i out of range", lump);
+    }
 
-    // Go through each entry in the WAD directory, adding information
-    // about each entry to the MD5 hash.
+    l = &lumpinfo[lump];
 
-    for(i = 0; i < numlumps; ++i) {
-        ChecksumAddLump(&md5_context, &lumpinfo[i]);
+    if(l->cache) {
+        Z_ChangeTag(l->cache, PU_CACHE);
     }
+}
+
+//
+// W_UnlockLumpName
+//
 
-    MD5_Final(digest, &md5_context);
+void W_UnlockLumpName(const char* name) {
+    W_UnlockLumpNum(W_GetNumForName(name));
 }
@@ -35,6 +35,31 @@
 #include "w_file.h"
 #include "w_merge.h"
 
+#ifdef _MSC_VER
+#pragma pack(push, 1)
+#endif
+
+//
+// TYPES
+//
+typedef struct {
+    // Should be "IWAD" or "PWAD".
+    char        identification[4];
+    int            numlumps;
+    int            infotableofs;
+} PACKEDATTR wadinfo_t;
+
+
+typedef struct {
+    int            filepos;
+    int            size;
+    char        name[8];
+} PACKEDATTR filelump_t;
+
+#ifdef _MSC_VER
+#pragma pack(pop)
+#endif
+
 //
 // WADFILE I/O related stuff.
 //
@@ -46,8 +71,15 @@ typedef struct {
     int         next;
     int         index;
     void*       cache;
+    dboolean    compressed;
 } lumpinfo_t;
 
+// Lumps with the high bit of the first name character set are stored
+// deflated. The directory size is the inflated size; the data starts
+// with a 32-bit little-endian length of the compressed stream that follows.
+
+#define LUMP_COMPRESSED     0x80
+
 extern lumpinfo_t* lumpinfo;
 extern int numlumps;
 
@@ -64,6 +96,11 @@ void            W_FreeMapLump(void);
 int             W_MapLumpLength(int lump);
 void*           W_CacheLumpNum(int lump, int tag);
 void*           W_CacheLumpName(const char* name, int tag);
+void            W_ReleaseLumpNum(int lump);
+void            W_ReleaseLumpName(const char* name);
+void            W_UnlockLumpNum(int lump);
+void            W_UnlockLumpName(const char* name);
+dboolean        W_InflateLump(byte* src, int srclen, void* dest, int destlen);
 
 
 
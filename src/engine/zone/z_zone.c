@@ -33,21 +33,121 @@
 #include "i_system.h"
 #include "doomdef.h"
 #include "doomstat.h"
+#include "con_cvar.h"
 
 #define ZONEID    0x1d4a11
 //#define ZONEFILE
 
 typedef struct memblock_s memblock_t;
 
+// kept to the size of the original header, with the
+// bookkeeping packed into the word that used to be padding
+
 struct memblock_s {
     int id; // = ZONEID
-    int tag;
+    unsigned int tag : 8;
+    unsigned int arena : 1;     // carved out of a level arena
+    unsigned int cached : 1;    // counted as a PU_CACHE miss already
+    unsigned int pool : 16;     // slot in zpoollist[pool - 1], 0 if not pooled
     int size;
+    unsigned int site;  // profiler run and call site, 0 if not profiled
     void **user;
     memblock_t *prev;
     memblock_t *next;
 };
 
+//
+// Level lifetime tags are bump allocated out of chunked arenas and
+// released a whole chunk at a time by Z_FreeTags. Arena blocks keep a
+// normal memblock_t header so everything else works on them, but they
+// are only linked into their tag's list when they have an owner to
+// clear. Z_Free on one just marks it dead.
+//
+
+#define Z_IsArenaTag(tag)   ((tag) == PU_LEVEL || (tag) == PU_LEVSPEC)
+#define Z_IsLinked(block)   (!(block)->arena || (block)->user != NULL)
+
+#define ZARENA_ALIGN(x)     (((x) + 15) & ~15)
+#define ZARENA_CHUNKSIZE    0x40000
+#define ZARENA_BLOCKHEADER  ZARENA_ALIGN(sizeof(memblock_t))
+
+typedef struct zchunk_s zchunk_t;
+
+struct zchunk_s {
+    zchunk_t *next;
+    int size;
+    int used;
+};
+
+#define ZARENA_CHUNKHEADER  ZARENA_ALIGN(sizeof(zchunk_t))
+
+typedef struct {
+    zchunk_t *chunks;   // head is the chunk being filled
+    int live;           // bytes in blocks not yet freed
+} zarena_t;
+
+static zarena_t level_arenas[PU_MAX];
+
+//
+// Fixed size pools hand out slots carved from their tag's arena in
+// slabs. Freed slots go onto an intrusive free list, threaded through
+// the memblock_t header, and are reused before the pool grows again.
+// Small PU_LEVSPEC allocations get a pool per size automatically,
+// which in practice means one per thinker type.
+//
+
+#define ZPOOL_SLABSIZE      0x4000
+#define ZPOOL_MAXAUTO       512
+#define ZPOOL_ALIGN(x, a)   (((x) + (a) - 1) & ~((a) - 1))
+
+struct zpool_s {
+    char name[16];
+    int size;
+    int stride;     // distance between slots
+    int offset;     // slot start to data, so data lands on align
+    int align;
+    int tag;
+    memblock_t *freelist;
+    int used;
+    int slots;
+    int peak;
+    int num;        // what memblock_t::pool holds for its slots
+    zpool_t *next;
+};
+
+static zpool_t *zpools;
+static zpool_t **zpoollist;
+static int numzpools;
+
+#define ZPOOL_MAXPOOLS      0xffff
+static zpool_t *size_pools[ZPOOL_MAXAUTO + 1];
+
+static void Z_ReleaseToPool(memblock_t *block);
+
+//
+// Z_Alloca scratch memory is bump allocated out of a linear arena that
+// Z_FreeAlloca resets every frame. When a frame outgrows it, a chunk of
+// at least twice the size is pushed in front, and at the next reset
+// the smaller ones are dropped so later frames fit in one chunk.
+//
+
+#define ZSCRATCH_INITSIZE   0x10000
+
+typedef struct zscratch_s zscratch_t;
+
+struct zscratch_s {
+    zscratch_t *next;
+    int size;
+    int used;
+};
+
+#define ZSCRATCH_HEADER     ZARENA_ALIGN(sizeof(zscratch_t))
+
+static zscratch_t *scratch;
+static int scratch_used;        // bytes handed out this frame
+static int scratch_framepeak;   // bytes used by the last frame
+static int scratch_peak;        // most used by any frame
+
 #ifdef ZONEFILE
 
 static FILE *zonelog;
@@ -90,12 +190,30 @@ static void Z_LogPuts(const char *msg) {
 
 static memblock_t *allocated_blocks[PU_MAX];
 
+// The PU_CACHE list is kept in LRU order: new and touched blocks go
+// to the head, evictions come off the tail
+
+static memblock_t *cache_tail;
+static int cache_bytes;
+
+static int cache_hits;
+static int cache_misses;
+static int cache_evictions;
+
+// PU_CACHE budget in kilobytes, 0 for no limit
+CVAR(z_cachesize, 32768);
+
 //
 // Z_InsertBlock
 // Add a block into the linked list for its type.
 //
 
 static void Z_InsertBlock(memblock_t *block) {
+    if(!Z_IsLinked(block)) {
+        block->prev = block->next = NULL;
+        return;
+    }
+
     block->prev = NULL;
     block->next = allocated_blocks[block->tag];
     allocated_blocks[block->tag] = block;
@@ -103,6 +221,21 @@ static void Z_InsertBlock(memblock_t *block) {
     if(block->next != NULL) {
         block->next->prev = block;
     }
+
+    if(block->tag == PU_CACHE) {
+        if(block->next == NULL) {
+            cache_tail = block;
+        }
+
+        cache_bytes += block->size;
+
+        // a block only misses once, going back and forth
+        // between PU_CACHE and a locked tag after that is a hit
+        if(!block->cached) {
+            block->cached = true;
+            cache_misses++;
+        }
+    }
 }
 
 //
@@ -111,6 +244,10 @@ static void Z_InsertBlock(memblock_t *block) {
 //
 
 static void Z_RemoveBlock(memblock_t *block) {
+    if(!Z_IsLinked(block)) {
+        return;
+    }
+
     // Unlink from list
     if(block->prev == NULL) {
         allocated_blocks[block->tag] = block->next;    // Start of list
@@ -122,6 +259,300 @@ static void Z_RemoveBlock(memblock_t *block) {
     if(block->next != NULL) {
         block->next->prev = block->prev;
     }
+
+    if(block->tag == PU_CACHE) {
+        if(block == cache_tail) {
+            cache_tail = block->prev;
+        }
+
+        cache_bytes -= block->size;
+    }
+}
+
+//
+// Allocation site profiler. While running, every allocation is
+// charged to its (file, line, tag) call site. Blocks remember their
+// site so frees can take the bytes off its live count. The top 8 bits
+// of memblock_t::site hold the profiling run, so blocks left over
+// from an earlier run are ignored.
+//
+
+#define ZPROF_HASHSIZE      1024
+#define ZPROF_SITE(x)       (((x) & 0xffffff) - 1)
+#define ZPROF_RUN(x)        ((x) >> 24)
+
+typedef struct {
+    const char  *file;
+    int         line;
+    int         tag;
+    int         count;
+    int64       bytes;
+    int         live;
+    int         peak;
+    int         next;
+} zsite_t;
+
+static zsite_t *prof_sites;
+static int prof_numsites;
+static int prof_maxsites;
+static int prof_hash[ZPROF_HASHSIZE];
+static zsite_t prof_tags[PU_MAX];
+static unsigned int prof_run;
+static dboolean prof_active;
+
+//
+// Z_ProfileSite
+//
+
+static int Z_ProfileSite(const char *file, int line, int tag) {
+    zsite_t *site;
+    int hash;
+    int i;
+
+    hash = ((int)(((size_t)file) >> 3) ^ (line * 31) ^ tag) & (ZPROF_HASHSIZE - 1);
+
+    for(i = prof_hash[hash]; i != -1; i = prof_sites[i].next) {
+        site = &prof_sites[i];
+
+        // __FILE__ strings may or may not be merged by the compiler
+        if(site->line == line && site->tag == tag &&
+                (site->file == file || !dstrcmp(site->file, file))) {
+            return i;
+        }
+    }
+
+    if(prof_numsites == prof_maxsites) {
+        prof_maxsites = prof_maxsites ? prof_maxsites * 2 : 256;
+        prof_sites = realloc(prof_sites, prof_maxsites * sizeof(zsite_t));
+
+        if(prof_sites == NULL) {
+            I_Error("Z_ProfileSite: Couldn't realloc sites");
+        }
+    }
+
+    site = &prof_sites[prof_numsites];
+    dmemset(site, 0, sizeof(zsite_t));
+    site->file = file;
+    site->line = line;
+    site->tag = tag;
+    site->next = prof_hash[hash];
+
+    prof_hash[hash] = prof_numsites;
+
+    return prof_numsites++;
+}
+
+//
+// Z_ProfileCharge
+// Adds to the live bytes of a site and of its tag
+//
+
+static void Z_ProfileCharge(zsite_t *site, int size) {
+    zsite_t *tag = &prof_tags[site->tag];
+
+    site->live += size;
+    tag->live += size;
+
+    if(site->live > site->peak) {
+        site->peak = site->live;
+    }
+
+    if(tag->live > tag->peak) {
+        tag->peak = tag->live;
+    }
+}
+
+//
+// Z_ProfileAlloc
+//
+
+static void Z_ProfileAlloc(memblock_t *block, const char *file, int line) {
+    zsite_t *site;
+    int i;
+
+    if(!prof_active) {
+        block->site = 0;
+        return;
+    }
+
+    i = Z_ProfileSite(file, line, block->tag);
+    site = &prof_sites[i];
+
+    site->count++;
+    site->bytes += block->size;
+    prof_tags[block->tag].count++;
+    prof_tags[block->tag].bytes += block->size;
+
+    Z_ProfileCharge(site, block->size);
+
+    block->site = (prof_run << 24) | (i + 1);
+}
+
+//
+// Z_ProfileRelease
+//
+
+static void Z_ProfileRelease(memblock_t *block) {
+    if(block->site == 0 || ZPROF_RUN(block->site) != prof_run) {
+        return;
+    }
+
+    Z_ProfileCharge(&prof_sites[ZPROF_SITE(block->site)], -block->size);
+    block->site = 0;
+}
+
+//
+// Z_ProfileRetag
+// Moves a block's live bytes over to the same call site under its new tag
+//
+
+static void Z_ProfileRetag(memblock_t *block) {
+    zsite_t *site;
+    int i;
+
+    if(block->site == 0 || ZPROF_RUN(block->site) != prof_run) {
+        return;
+    }
+
+    site = &prof_sites[ZPROF_SITE(block->site)];
+    Z_ProfileCharge(site, -block->size);
+
+    i = Z_ProfileSite(site->file, site->line, block->tag);
+    Z_ProfileCharge(&prof_sites[i], block->size);
+
+    block->site = (prof_run << 24) | (i + 1);
+}
+
+//
+// Z_ProfileFreeTag
+// Everything under the tag is gone at once, including
+// arena blocks that Z_FreeTags never gets to see
+//
+
+static void Z_ProfileFreeTag(int tag) {
+    int i;
+
+    for(i = 0; i < prof_numsites; i++) {
+        if(prof_sites[i].tag == tag) {
+            prof_sites[i].live = 0;
+        }
+    }
+
+    prof_tags[tag].live = 0;
+}
+
+//
+// Z_ProfileStart
+//
+
+void Z_ProfileStart(void) {
+    int i;
+
+    for(i = 0; i < ZPROF_HASHSIZE; i++) {
+        prof_hash[i] = -1;
+    }
+
+    dmemset(prof_tags, 0, sizeof(prof_tags));
+
+    prof_numsites = 0;
+    prof_run = (prof_run + 1) & 0xff;
+
+    if(prof_run == 0) {
+        prof_run = 1;
+    }
+
+    prof_active = true;
+}
+
+//
+// Z_ProfileStop
+// Counts are kept around for Z_ProfileDump
+//
+
+void Z_ProfileStop(void) {
+    prof_active = false;
+}
+
+//
+// Z_ProfileActive
+//
+
+int Z_ProfileActive(void) {
+    return prof_active;
+}
+
+//
+// Z_ProfileCompare
+//
+
+static int Z_ProfileCompare(const void *a, const void *b) {
+    const zsite_t *sa = &prof_sites[*(const int*)a];
+    const zsite_t *sb = &prof_sites[*(const int*)b];
+
+    if(sa->bytes != sb->bytes) {
+        return sa->bytes > sb->bytes ? -1 : 1;
+    }
+
+    return sb->count - sa->count;
+}
+
+//
+// Z_ProfileDump
+// Writes the call sites, biggest total first, and a per tag summary.
+// Returns the number of sites written or -1 if the file can't be opened.
+//
+
+int Z_ProfileDump(const char *path) {
+    static const char *tagnames[PU_MAX] = {
+        "static", "maplump", "auto", "audio", "level", "levspec", "cache"
+    };
+    int *order;
+    FILE *f;
+    int i;
+
+    if(!(f = fopen(path, "w"))) {
+        return -1;
+    }
+
+    order = malloc(MAX(prof_numsites, 1) * sizeof(int));
+
+    for(i = 0; i < prof_numsites; i++) {
+        order[i] = i;
+    }
+
+    qsort(order, prof_numsites, sizeof(int), Z_ProfileCompare);
+
+    fprintf(f, "Zone allocation profile (%s, gametic %d)\n\n",
+            prof_active ? "running" : "stopped", gametic);
+
+    fprintf(f, "%-8s %10s %14s %12s %12s\n", "tag", "allocs", "bytes", "live", "peak");
+
+    for(i = 0; i < PU_MAX; i++) {
+        zsite_t *tag = &prof_tags[i];
+
+        if(tag->count == 0 && tag->peak == 0) {
+            continue;
+        }
+
+        fprintf(f, "%-8s %10d %14lld %12d %12d\n", tagnames[i], tag->count,
+                (long long)tag->bytes, tag->live, tag->peak);
+    }
+
+    fprintf(f, "\n%10s %14s %12s %12s %-8s %s\n",
+            "allocs", "bytes", "live", "peak", "tag", "source");
+
+    for(i = 0; i < prof_numsites; i++) {
+        zsite_t *site = &prof_sites[order[i]];
+
+        fprintf(f, "%10d %14lld %12d %12d %-8s %s:%d\n", site->count,
+                (long long)site->bytes, site->live, site->peak,
+                tagnames[site->tag], site->file, site->line);
+    }
+
+    fclose(f);
+    free(order);
+
+    return prof_numsites;
 }
 
 //
@@ -130,6 +561,10 @@ static void Z_RemoveBlock(memblock_t *block) {
 
 void Z_Init(void) {
     dmemset(allocated_blocks, 0, sizeof(allocated_blocks));
+    dmemset(level_arenas, 0, sizeof(level_arenas));
+
+    cache_tail = NULL;
+    cache_bytes = 0;
 
 #ifdef ZONEFILE
     atexit(Z_CloseLogFile); // exit handler
@@ -159,9 +594,20 @@ void (Z_Free)(void* ptr, const char *file, int line) {
     }
 
     Z_RemoveBlock(block);
+    Z_ProfileRelease(block);
 
-    // Free back to system
-    free(block);
+    if(block->pool) {
+        Z_ReleaseToPool(block);
+    }
+    else if(block->arena) {
+        // the memory comes back when the whole arena is released
+        level_arenas[block->tag].live -= block->size;
+        block->id = 0;
+    }
+    else {
+        // Free back to system
+        free(block);
+    }
 
 #ifdef ZONEFILE
     Z_LogPrintf("* Z_Free(ptr=%p, file=%s:%d)\n", ptr, file, line);
@@ -172,45 +618,24 @@ void (Z_Free)(void* ptr, const char *file, int line) {
 // Z_ClearCache
 //
 // Empty data from the cache list to allocate enough data of the size
-// required.
+// required, least recently used first.
 //
 // Returns true if any blocks were freed.
 //
 
 static dboolean Z_ClearCache(int size) {
     memblock_t *block;
-    memblock_t *next_block;
     int remaining;
 
-    block = allocated_blocks[PU_CACHE];
-
-    if(block == NULL) {
+    if(cache_tail == NULL) {
         // Cache is already empty.
         return false;
     }
 
-    //
-    // Search to the end of the PU_CACHE list.  The blocks at the end
-    // of the list are the ones that have been free for longer and
-    // are more likely to be unneeded now.
-    //
-    while(block->next != NULL) {
-        block = block->next;
-    }
-
-    //
-    // Search backwards through the list freeing blocks until we have
-    // freed the amount of memory required.
-    //
     remaining = size;
 
-    while(remaining > 0) {
-        if(block == NULL) {
-            // No blocks left to free; we've done our best.
-            break;
-        }
-
-        next_block = block->prev;
+    while(remaining > 0 && cache_tail != NULL) {
+        block = cache_tail;
 
         Z_RemoveBlock(block);
 
@@ -220,14 +645,342 @@ static dboolean Z_ClearCache(int size) {
             *block->user = NULL;
         }
 
+        Z_ProfileRelease(block);
         free(block);
 
-        block = next_block;
+        cache_evictions++;
     }
 
     return true;
 }
 
+//
+// Z_EnforceCacheBudget
+//
+// Evict from the cache until it has room for the given
+// number of incoming bytes within z_cachesize.
+//
+
+static void Z_EnforceCacheBudget(int incoming) {
+    int budget;
+
+    if(z_cachesize.value <= 0) {
+        return;
+    }
+
+    budget = (int)z_cachesize.value << 10;
+
+    if(cache_bytes + incoming > budget) {
+        Z_ClearCache(cache_bytes + incoming - budget);
+    }
+}
+
+//
+// Z_ArenaRaw
+// Bump allocates 16 byte aligned memory out of the arena for a
+// level tag. Allocations bigger than a chunk get a chunk of their
+// own, slotted in behind the one being filled so it isn't wasted.
+//
+
+static byte *Z_ArenaRaw(int size, int tag) {
+    zarena_t *arena;
+    zchunk_t *chunk;
+    byte *data;
+    int need;
+    int chunksize;
+
+    arena = &level_arenas[tag];
+    need = ZARENA_ALIGN(size);
+    chunk = arena->chunks;
+
+    if(chunk == NULL || chunk->used + need > chunk->size) {
+        chunksize = MAX(ZARENA_CHUNKSIZE, need);
+
+        if(!(chunk = (zchunk_t*)malloc(ZARENA_CHUNKHEADER + chunksize))) {
+            if(Z_ClearCache(ZARENA_CHUNKHEADER + chunksize)) {
+                chunk = (zchunk_t*)malloc(ZARENA_CHUNKHEADER + chunksize);
+            }
+
+            if(!chunk) {
+                return NULL;
+            }
+        }
+
+        chunk->size = chunksize;
+        chunk->used = 0;
+
+        if(chunksize > ZARENA_CHUNKSIZE && arena->chunks != NULL) {
+            chunk->next = arena->chunks->next;
+            arena->chunks->next = chunk;
+        }
+        else {
+            chunk->next = arena->chunks;
+            arena->chunks = chunk;
+        }
+    }
+
+    data = (byte*)chunk + ZARENA_CHUNKHEADER + chunk->used;
+    chunk->used += need;
+
+    return data;
+}
+
+//
+// Z_ArenaAlloc
+//
+
+static memblock_t *Z_ArenaAlloc(int size, int tag) {
+    byte *data;
+
+    if(!(data = Z_ArenaRaw(ZARENA_BLOCKHEADER + size, tag))) {
+        return NULL;
+    }
+
+    level_arenas[tag].live += size;
+
+    return (memblock_t*)(data + ZARENA_BLOCKHEADER - sizeof(memblock_t));
+}
+
+//
+// Z_ArenaResize
+// Resizes an arena block without moving it. Any block can
+// shrink, but only the last one carved from the chunk being
+// filled can grow, and only while the chunk has room
+//
+
+static dboolean Z_ArenaResize(memblock_t *block, int size, const char *file, int line) {
+    zchunk_t *chunk;
+    byte *data;
+    byte *end;
+    int used;
+
+    if(block->pool) {
+        return false;
+    }
+
+    data = (byte*)block + sizeof(memblock_t) - ZARENA_BLOCKHEADER;
+    chunk = level_arenas[block->tag].chunks;
+
+    if(chunk != NULL) {
+        end = (byte*)chunk + ZARENA_CHUNKHEADER + chunk->used;
+
+        if(data + ZARENA_ALIGN(ZARENA_BLOCKHEADER + block->size) == end) {
+            used = (int)(data - ((byte*)chunk + ZARENA_CHUNKHEADER)) +
+                   ZARENA_ALIGN(ZARENA_BLOCKHEADER + size);
+
+            if(used > chunk->size) {
+                return false;
+            }
+
+            chunk->used = used;
+        }
+        else if(size > block->size) {
+            return false;
+        }
+    }
+    else if(size > block->size) {
+        return false;
+    }
+
+    Z_ProfileRelease(block);
+
+    level_arenas[block->tag].live += size - block->size;
+    block->size = size;
+
+    Z_ProfileAlloc(block, file, line);
+
+    return true;
+}
+
+//
+// Z_FreeArena
+//
+
+static void Z_FreeArena(int tag) {
+    zchunk_t *chunk;
+    zchunk_t *next;
+
+    for(chunk = level_arenas[tag].chunks; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+
+    level_arenas[tag].chunks = NULL;
+    level_arenas[tag].live = 0;
+}
+
+//
+// Z_CreatePool
+// Slots are aligned to align bytes, which must be a power of two
+//
+
+zpool_t *Z_CreatePool(const char *name, int size, int tag, int align) {
+    zpool_t *pool;
+
+    if(!Z_IsArenaTag(tag)) {
+        I_Error("Z_CreatePool: %s must use a level tag", name);
+    }
+
+    align = MAX(align, 16);
+
+    pool = (zpool_t*)malloc(sizeof(zpool_t));
+
+    if(!pool) {
+        I_Error("Z_CreatePool: couldn't allocate pool %s", name);
+    }
+
+    dmemset(pool, 0, sizeof(zpool_t));
+    dsnprintf(pool->name, sizeof(pool->name), "%s", name);
+
+    if(numzpools == ZPOOL_MAXPOOLS) {
+        I_Error("Z_CreatePool: too many pools for %s", name);
+    }
+
+    zpoollist = (zpool_t**)realloc(zpoollist, (numzpools + 1) * sizeof(zpool_t*));
+
+    if(!zpoollist) {
+        I_Error("Z_CreatePool: couldn't grow the pool list for %s", name);
+    }
+
+    zpoollist[numzpools++] = pool;
+    pool->num = numzpools;
+
+    pool->size = size;
+    pool->align = align;
+    pool->tag = tag;
+    pool->offset = ZPOOL_ALIGN((int)sizeof(memblock_t), align);
+    pool->stride = pool->offset + ZPOOL_ALIGN(size, align);
+
+    pool->next = zpools;
+    zpools = pool;
+
+    return pool;
+}
+
+//
+// Z_GrowPool
+// Carves another slab of free slots out of the arena
+//
+
+static void Z_GrowPool(zpool_t *pool) {
+    memblock_t *block;
+    byte *slab;
+    int count;
+    int i;
+
+    count = MAX(1, ZPOOL_SLABSIZE / pool->stride);
+
+    if(!(slab = Z_ArenaRaw(count * pool->stride + pool->align, pool->tag))) {
+        I_Error("Z_GrowPool: failed to grow pool %s", pool->name);
+    }
+
+    slab = (byte*)ZPOOL_ALIGN((size_t)slab, (size_t)pool->align);
+
+    // link back to front so slots are handed out in address order
+    for(i = count - 1; i >= 0; i--) {
+        block = (memblock_t*)(slab + i * pool->stride + pool->offset - sizeof(memblock_t));
+        block->id = 0;
+        block->next = pool->freelist;
+        pool->freelist = block;
+    }
+
+    pool->slots += count;
+}
+
+//
+// Z_ReleaseToPool
+//
+
+static void Z_ReleaseToPool(memblock_t *block) {
+    zpool_t *pool = zpoollist[block->pool - 1];
+
+    level_arenas[block->tag].live -= block->size;
+
+    block->id = 0;
+    block->next = pool->freelist;
+    pool->freelist = block;
+
+    pool->used--;
+}
+
+//
+// Z_ResetPools
+// Their slabs went with the arena
+//
+
+static void Z_ResetPools(int tag) {
+    zpool_t *pool;
+
+    for(pool = zpools; pool != NULL; pool = pool->next) {
+        if(pool->tag == tag) {
+            pool->freelist = NULL;
+            pool->used = 0;
+            pool->slots = 0;
+        }
+    }
+}
+
+//
+// Z_GetSizePool
+//
+
+static zpool_t *Z_GetSizePool(int size) {
+    char name[16];
+
+    if(size_pools[size] == NULL) {
+        dsnprintf(name, sizeof(name), "levspec%d", size);
+        size_pools[size] = Z_CreatePool(name, size, PU_LEVSPEC, 16);
+    }
+
+    return size_pools[size];
+}
+
+//
+// Z_PoolAlloc
+//
+
+void *(Z_PoolAlloc)(zpool_t *pool, void *user, const char *file, int line) {
+    memblock_t *block;
+    void *result;
+
+    if(pool->freelist == NULL) {
+        Z_GrowPool(pool);
+    }
+
+    block = pool->freelist;
+    pool->freelist = block->next;
+
+    block->id = ZONEID;
+    block->tag = pool->tag;
+    block->size = pool->size;
+    block->arena = true;
+    block->cached = false;
+    block->pool = pool->num;
+    block->user = user;
+
+    Z_InsertBlock(block);
+    Z_ProfileAlloc(block, file, line);
+
+    level_arenas[pool->tag].live += pool->size;
+
+    if(++pool->used > pool->peak) {
+        pool->peak = pool->used;
+    }
+
+    result = (byte*)block + sizeof(memblock_t);
+
+    if(user != NULL) {
+        *block->user = result;
+    }
+
+#ifdef ZONEFILE
+    Z_LogPrintf("* %p = Z_PoolAlloc(pool=%s, user=%p, source=%s:%d)\n",
+                result, pool->name, user, file, line);
+#endif
+
+    return result;
+}
+
 //
 // Z_Malloc
 // You can pass a NULL user if the tag is < PU_PURGELEVEL.
@@ -246,11 +999,25 @@ void *(Z_Malloc)(int size, int tag, void *user, const char *file, int line) {
         I_Error("Z_Malloc: an owner is required for purgable blocks (%s:%d)", file, line);
     }
 
+    // Make room within the cache budget first, so the new
+    // block itself can never be the one evicted
+
+    Z_EnforceCacheBudget(tag == PU_CACHE ? size : 0);
+
+    // Small thinker sized blocks come out of a pool
+
+    if(tag == PU_LEVSPEC && size > 0 && size <= ZPOOL_MAXAUTO) {
+        return (Z_PoolAlloc)(Z_GetSizePool(size), user, file, line);
+    }
+
     // Malloc a block of the required size
 
     newblock = NULL;
 
-    if(!(newblock = (memblock_t*)malloc(sizeof(memblock_t) + size))) {
+    if(Z_IsArenaTag(tag)) {
+        newblock = Z_ArenaAlloc(size, tag);
+    }
+    else if(!(newblock = (memblock_t*)malloc(sizeof(memblock_t) + size))) {
         if(Z_ClearCache(sizeof(memblock_t) + size)) {
             newblock = (memblock_t*)malloc(sizeof(memblock_t) + size);
         }
@@ -266,8 +1033,12 @@ void *(Z_Malloc)(int size, int tag, void *user, const char *file, int line) {
     newblock->id = ZONEID;
     newblock->user = user;
     newblock->size = size;
+    newblock->arena = Z_IsArenaTag(tag);
+    newblock->cached = false;
+    newblock->pool = 0;
 
     Z_InsertBlock(newblock);
+    Z_ProfileAlloc(newblock, file, line);
 
     data = (unsigned char*)newblock;
     result = data + sizeof(memblock_t);
@@ -319,11 +1090,34 @@ void *(Z_Realloc)(void *ptr, int size, int tag, void *user, const char *file, in
         I_Error("Z_Realloc: Reallocated a pointer without ZONEID (%s:%d)", file, line);
     }
 
+    // arena blocks can only be resized in place at the end of
+    // their chunk, otherwise they move. Malloc'd blocks can't
+    // be moved into an arena by realloc
+    if(block->arena && tag == block->tag && user == (void*)block->user &&
+            Z_ArenaResize(block, size, file, line)) {
+        return ptr;
+    }
+
+    if(block->arena || Z_IsArenaTag(tag)) {
+        result = (Z_Malloc)(size, tag, user, file, line);
+        dmemcpy(result, ptr, MIN(size, block->size));
+        (Z_Free)(ptr, file, line);
+
+        if(user != NULL) {
+            *(void**)user = result;
+        }
+
+        return result;
+    }
+
     Z_RemoveBlock(block);
+    Z_ProfileRelease(block);
 
     block->next = NULL;
     block->prev = NULL;
 
+    Z_EnforceCacheBudget(tag == PU_CACHE ? size : 0);
+
     if(block->user) {
         *block->user = NULL;
     }
@@ -342,8 +1136,11 @@ void *(Z_Realloc)(void *ptr, int size, int tag, void *user, const char *file, in
     newblock->id = ZONEID;
     newblock->user = user;
     newblock->size = size;
+    newblock->arena = false;
+    newblock->pool = 0;
 
     Z_InsertBlock(newblock);
+    Z_ProfileAlloc(newblock, file, line);
 
     data = (unsigned char*)newblock;
     result = data + sizeof(memblock_t);
@@ -386,7 +1183,9 @@ void (Z_FreeTags)(int lowtag, int hightag, const char *file, int line) {
                 *block->user = NULL;
             }
 
-            free(block);
+            if(!block->arena) {
+                free(block);
+            }
 
             // Jump to the next in the chain
 
@@ -395,6 +1194,21 @@ void (Z_FreeTags)(int lowtag, int hightag, const char *file, int line) {
 
         // This chain is empty now
         allocated_blocks[i] = NULL;
+
+        if(prof_numsites > 0) {
+            Z_ProfileFreeTag(i);
+        }
+
+        // and everything carved out of the arena goes at once
+        if(Z_IsArenaTag(i)) {
+            Z_FreeArena(i);
+            Z_ResetPools(i);
+        }
+
+        if(i == PU_CACHE) {
+            cache_tail = NULL;
+            cache_bytes = 0;
+        }
     }
 
 #ifdef ZONEFILE
@@ -451,6 +1265,16 @@ void (Z_Touch)(void *ptr, const char *file, int line) {
         I_Error("Z_Touch: touched a pointer without ZONEID (%s:%d)", file, line);
     }
 
+    // move cached blocks to the most recently used end
+    if(block->tag == PU_CACHE) {
+        cache_hits++;
+
+        if(block != allocated_blocks[PU_CACHE]) {
+            Z_RemoveBlock(block);
+            Z_InsertBlock(block);
+        }
+    }
+
 #ifdef ZONEFILE
     Z_LogPrintf("* Z_Touch(ptr=%p, file=%s:%d)\n", ptr, file, line);
 #endif
@@ -461,21 +1285,70 @@ void (Z_Touch)(void *ptr, const char *file, int line) {
 //
 
 void (Z_FreeAlloca)(const char *file, int line) {
+    zscratch_t *next;
+
 #ifdef ZONEFILE
     Z_LogPrintf("* Z_FreeAlloca(file=%s:%d)\n", file, line);
 #endif
-    (Z_FreeTags)(PU_AUTO, PU_AUTO, file, line);
+
+    if(scratch != NULL) {
+        while(scratch->next != NULL) {
+            next = scratch->next->next;
+            free(scratch->next);
+            scratch->next = next;
+        }
+
+        scratch->used = 0;
+    }
+
+    scratch_framepeak = scratch_used;
+
+    if(scratch_used > scratch_peak) {
+        scratch_peak = scratch_used;
+    }
+
+    scratch_used = 0;
 }
 
 //
 // Z_Alloca
+// Scratch memory that only lives until the next Z_FreeAlloca.
+// Comes back zeroed.
 //
 
 void *(Z_Alloca)(int n, const char *file, int line) {
+    zscratch_t *chunk;
+    byte *result;
+    int size;
+
 #ifdef ZONEFILE
     Z_LogPrintf("* Z_Alloca(file=%s:%d)\n", file, line);
 #endif
-    return n == 0 ? NULL : (Z_Calloc)(n, PU_AUTO, NULL, file, line);
+
+    if(n == 0) {
+        return NULL;
+    }
+
+    n = ZARENA_ALIGN(n);
+
+    if(scratch == NULL || scratch->used + n > scratch->size) {
+        size = scratch ? MAX(scratch->size * 2, n) : MAX(ZSCRATCH_INITSIZE, n);
+
+        if(!(chunk = (zscratch_t*)malloc(ZSCRATCH_HEADER + size))) {
+            I_Error("Z_Alloca: failed on allocation of %u bytes (%s:%d)", n, file, line);
+        }
+
+        chunk->size = size;
+        chunk->used = 0;
+        chunk->next = scratch;
+        scratch = chunk;
+    }
+
+    result = (byte*)scratch + ZSCRATCH_HEADER + scratch->used;
+    scratch->used += n;
+    scratch_used += n;
+
+    return dmemset(result, 0, n);
 }
 
 //
@@ -546,13 +1419,26 @@ void (Z_ChangeTag)(void *ptr, int tag, const char *file, int line) {
         I_Error("Z_ChangeTag: an owner is required for purgable blocks (%s:%d)", file, line);
     }
 
+    // the block's memory belongs to its tag's arena
+    if(block->arena && tag != block->tag) {
+        I_Error("Z_ChangeTag: level arena blocks can't change tag (%s:%d)", file, line);
+    }
+
     //
     // Remove the block from its current list, and rehook it into
     // its new list.
     //
     Z_RemoveBlock(block);
+
+    // the block is out of the cache list, so making room for it
+    // can't evict it
+    if(tag == PU_CACHE) {
+        Z_EnforceCacheBudget(block->size);
+    }
+
     block->tag = tag;
     Z_InsertBlock(block);
+    Z_ProfileRetag(block);
 
 #ifdef ZONEFILE
     Z_LogPrintf("* Z_ChangeTag(ptr=%p, tag=%d, file=%s:%d)\n",
@@ -573,10 +1459,12 @@ int Z_TagUsage(int tag) {
     }
 
     for(block = allocated_blocks[tag]; block != NULL; block = block->next) {
-        bytes += block->size;
+        if(!block->arena) {
+            bytes += block->size;
+        }
     }
 
-    return bytes;
+    return bytes + level_arenas[tag].live;
 }
 
 //
@@ -590,10 +1478,70 @@ int Z_FreeMemory(void) {
 
     for(i = 0; i < PU_MAX; i++) {
         for(block = allocated_blocks[i]; block != NULL; block = block->next) {
-            bytes += block->size;
+            if(!block->arena) {
+                bytes += block->size;
+            }
         }
+
+        bytes += level_arenas[i].live;
     }
 
     return bytes;
 }
 
+//
+// Z_PoolUsage
+//
+
+void Z_PoolUsage(zpool_t *pool, int *used, int *slots, int *peak) {
+    *used = pool->used;
+    *slots = pool->slots;
+    *peak = pool->peak;
+}
+
+//
+// Z_SizePoolUsage
+// Totals for the automatic PU_LEVSPEC pools
+//
+
+void Z_SizePoolUsage(int *used, int *slots, int *pools) {
+    int i;
+
+    *used = *slots = *pools = 0;
+
+    for(i = 0; i <= ZPOOL_MAXAUTO; i++) {
+        if(size_pools[i] != NULL) {
+            *used += size_pools[i]->used;
+            *slots += size_pools[i]->slots;
+            (*pools)++;
+        }
+    }
+}
+
+//
+// Z_AllocaUsage
+//
+
+void Z_AllocaUsage(int *size, int *framepeak, int *peak) {
+    *size = scratch ? scratch->size : 0;
+    *framepeak = scratch_framepeak;
+    *peak = scratch_peak;
+}
+
+//
+// Z_CacheStats
+//
+
+void Z_CacheStats(int *hits, int *misses, int *evictions) {
+    *hits = cache_hits;
+    *misses = cache_misses;
+    *evictions = cache_evictions;
+}
+
+//
+// Z_RegisterCvars
+//
+
+void Z_RegisterCvars(void) {
+    CON_CvarRegister(&z_cachesize);
+}
@@ -50,7 +50,7 @@
 enum {
     PU_STATIC,  // block is static (remains until explicitly freed)
     PU_MAPLUMP, // block is allocated for data stored in map wads
-    PU_AUTO,
+    PU_AUTO,    // no longer used, Z_Alloca has its own arena
     PU_AUDIO,   // allocation of midi data
     PU_LEVEL,   // allocation belongs to level (freed at next level load)
     PU_LEVSPEC, // used for thinker_t's (same as PU_LEVEL basically)
@@ -60,6 +60,10 @@ enum {
 
 #define PU_PURGELEVEL PU_CACHE        /* First purgable tag's level */
 
+// Fixed size slot pools for level lifetime objects.
+// Slots are freed with Z_Free like any other block.
+typedef struct zpool_s zpool_t;
+
 void*   (Z_Malloc)(int size, int tag, void *user, const char *, int);
 void (Z_Free)(void *ptr, const char *, int);
 void (Z_FreeTags)(int lowtag, int hightag, const char *, int);
@@ -74,6 +78,8 @@ void (Z_FreeAlloca)(const char *file, int line);
 void (Z_CheckHeap)(const char *,int);      // killough 3/22/98: add file/line info
 int (Z_CheckTag)(void *,const char *,int);
 void (Z_Touch)(void *ptr, const char *, int);
+zpool_t* Z_CreatePool(const char *name, int size, int tag, int align);
+void*   (Z_PoolAlloc)(zpool_t *pool, void *user, const char *, int);
 
 #define Z_Free(a)           (Z_Free)        (a,      __FILE__,__LINE__)
 #define Z_FreeTags(a,b)     (Z_FreeTags)    (a,b,    __FILE__,__LINE__)
@@ -88,11 +94,23 @@ void (Z_Touch)(void *ptr, const char *, int);
 #define Z_CheckTag(a)       (Z_CheckTag)    (a,      __FILE__,__LINE__)
 #define Z_Touch(a)          (Z_Touch)       (a,      __FILE__,__LINE__)
 #define Z_FreeAlloca()      (Z_FreeAlloca)  (        __FILE__,__LINE__)
+#define Z_PoolAlloc(a,b)    (Z_PoolAlloc)   (a,b,    __FILE__,__LINE__)
 
 #define strdup(s)           (Z_Strdup) (s, PU_STATIC,0,__FILE__,__LINE__)
 
 int Z_TagUsage(int tag);
 int Z_FreeMemory(void);
+void Z_CacheStats(int *hits, int *misses, int *evictions);
+void Z_PoolUsage(zpool_t *pool, int *used, int *slots, int *peak);
+void Z_SizePoolUsage(int *used, int *slots, int *pools);
+void Z_AllocaUsage(int *size, int *framepeak, int *peak);
+void Z_RegisterCvars(void);
+
+// Allocation site profiler
+void Z_ProfileStart(void);
+void Z_ProfileStop(void);
+int Z_ProfileActive(void);
+int Z_ProfileDump(const char *path);
 
 #endif
 
@@ -1,164 +1,544 @@
-
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <zlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/* Lump data is only ever held in memory this many bytes at a time */
+#define BUFFER_SIZE (64 * 1024)
 
-static const char *src_dir = NULL;
+#define HASH_SIZE 4096
+#define MAX_THREADS 64
+
+static const char *manifest_path = NULL;
 static const char *wad_path = NULL;
+static int compress_lumps = 0;
+static int num_threads = 0;
 
-static size_t lumpcnt = 0;
 static FILE *wad = NULL;
 
 typedef struct lump {
-    const char *file;
+    char *file;         /* NULL for markers */
     char name[8];
-    int size;
+    int size;           /* size of the source data */
+    int filepos;
+
+    /* filled in by the scan threads */
+    unsigned long long hash;
+    FILE *packed;       /* spill file holding the deflated data, with -z */
+    long packed_pos;
+    int packed_size;
+    const char *error;
 
-    struct lump *next;
+    struct lump *hash_next;
 } lump_t;
 
-static lump_t *lumps_begin = NULL;
-static lump_t *lumps_end = NULL;
+static lump_t *lumps = NULL;
 static int num_lumps = 0;
+static int max_lumps = 0;
 
-static void add_marker(const char *name)
+static lump_t *hash_table[HASH_SIZE];
+
+/* one per scan thread, so open files don't grow with the lump count */
+static FILE *spill_files[MAX_THREADS];
+
+#ifdef _WIN32
+static volatile LONG next_lump = 0;
+#define claim_lump() ((int) InterlockedIncrement(&next_lump) - 1)
+#else
+static volatile int next_lump = 0;
+#define claim_lump() __sync_fetch_and_add(&next_lump, 1)
+#endif
+
+static void add_lump(const char *name, const char *file)
 {
     lump_t *new_lump;
 
-    new_lump = calloc(1, sizeof(*new_lump));
+    if (num_lumps == max_lumps) {
+        max_lumps = max_lumps ? max_lumps * 2 : 256;
+        lumps = realloc(lumps, max_lumps * sizeof(*lumps));
 
-    strncpy(new_lump->name, name, 8);
+        if (!lumps) {
+            printf("Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
 
-    if (lumps_end) {
-        lumps_end->next = new_lump;
-        lumps_end = new_lump;
-    } else {
-        new_lump->next = NULL;
-        lumps_begin = lumps_end = new_lump;
+    new_lump = &lumps[num_lumps++];
+    memset(new_lump, 0, sizeof(*new_lump));
+
+    /* the manifest reader has already checked the length */
+    memcpy(new_lump->name, name, strlen(name));
+
+    if (file) {
+        new_lump->file = strdup(file);
+    }
+}
+
+/*
+ * Each manifest line is a lump name, optionally followed by the path of
+ * the file holding its data relative to the manifest. A name alone adds
+ * an empty marker lump. Anything after a '#' is a comment.
+ */
+static void read_manifest(void)
+{
+    FILE *f;
+    char line[1024], path[1024];
+    const char *slash;
+    int base_len;
+    int line_num = 0;
+
+    if (!(f = fopen(manifest_path, "r"))) {
+        perror("Couldn't open manifest");
+        exit(EXIT_FAILURE);
+    }
+
+    slash = strrchr(manifest_path, '/');
+#ifdef _WIN32
+    if (strrchr(manifest_path, '\\') > slash) {
+        slash = strrchr(manifest_path, '\\');
     }
+#endif
+    base_len = slash ? (int) (slash - manifest_path) + 1 : 0;
 
-    num_lumps++;
+    while (fgets(line, sizeof(line), f)) {
+        char *name, *file, *p;
+
+        line_num++;
+
+        if ((p = strchr(line, '#'))) {
+            *p = 0;
+        }
+
+        name = strtok(line, " \t\r\n");
+        file = strtok(NULL, " \t\r\n");
+
+        if (!name) {
+            continue;
+        }
+
+        if (strlen(name) > 8) {
+            printf("%s:%d: lump name %s is longer than 8 characters\n", manifest_path, line_num, name);
+            exit(EXIT_FAILURE);
+        }
+
+        if (strtok(NULL, " \t\r\n")) {
+            printf("%s:%d: expected a lump name and an optional file\n", manifest_path, line_num);
+            exit(EXIT_FAILURE);
+        }
+
+        if (file) {
+            snprintf(path, sizeof(path), "%.*s%s", base_len, manifest_path, file);
+            add_lump(name, path);
+        } else {
+            add_lump(name, NULL);
+        }
+    }
+
+    fclose(f);
 }
 
-static void add_file(const char *name, const char *file)
+/*
+ * Reads a lump's source once, hashing it and, with -z, deflating it onto
+ * the end of the thread's spill file. Lumps that don't shrink give their
+ * space in the spill file back and are stored as they are.
+ */
+static void scan_lump(lump_t *plump, FILE *spill, unsigned char *in, unsigned char *out)
 {
     FILE *f;
-    lump_t *new_lump;
-    char new_path[512];
+    z_stream zs;
+    unsigned long long hash = 14695981039346656037ULL;
+    long long size = 0;
+    size_t n, i;
+    int flush;
+
+    if (!(f = fopen(plump->file, "rb"))) {
+        plump->error = "Couldn't open file for reading";
+        return;
+    }
 
-    snprintf(new_path, 512, "%s/%s", src_dir, file);
-    new_lump = calloc(1, sizeof(*new_lump));
+    if (compress_lumps) {
+        memset(&zs, 0, sizeof(zs));
 
-    if (!(f=fopen(new_path, "rb"))) {
-        perror("Couldn't open file");
-        exit(EXIT_FAILURE);
+        if (!spill || deflateInit(&zs, Z_BEST_COMPRESSION) != Z_OK) {
+            plump->error = "Couldn't set up compression";
+            fclose(f);
+            return;
+        }
+
+        plump->packed = spill;
+        plump->packed_pos = ftell(spill);
+    }
+
+    do {
+        n = fread(in, 1, BUFFER_SIZE, f);
+
+        /* FNV-1a */
+        for (i = 0; i < n; i++) {
+            hash = (hash ^ in[i]) * 1099511628211ULL;
+        }
+
+        size += n;
+
+        if (!plump->packed) {
+            continue;
+        }
+
+        flush = n < BUFFER_SIZE ? Z_FINISH : Z_NO_FLUSH;
+        zs.next_in = in;
+        zs.avail_in = (uInt) n;
+
+        do {
+            zs.next_out = out;
+            zs.avail_out = BUFFER_SIZE;
+            deflate(&zs, flush);
+            fwrite(out, 1, BUFFER_SIZE - zs.avail_out, plump->packed);
+        } while (zs.avail_out == 0);
+    } while (n == BUFFER_SIZE);
+
+    if (ferror(f)) {
+        plump->error = "Couldn't read file";
+    } else if (size > 0x7fffffff) {
+        plump->error = "File is too large for a lump";
     }
 
-    fseek(f, 0, SEEK_END);
-    new_lump->size = ftell(f);
     fclose(f);
 
-    strncpy(new_lump->name, name, 8);
+    plump->hash = hash;
+    plump->size = (int) size;
 
-    new_lump->file = file;
-    if (lumps_end) {
-        lumps_end->next = new_lump;
-        lumps_end = new_lump;
-    } else {
-        new_lump->next = NULL;
-        lumps_begin = lumps_end = new_lump;
+    if (plump->packed) {
+        plump->packed_size = (int) zs.total_out;
+        deflateEnd(&zs);
+
+        if (ferror(plump->packed)) {
+            plump->error = "Couldn't write compressed data";
+        }
+
+        if (plump->packed_size + 4 >= plump->size) {
+            fseek(plump->packed, plump->packed_pos, SEEK_SET);
+            plump->packed = NULL;
+        }
+    }
+}
+
+static void scan_lumps(int thread)
+{
+    unsigned char *in, *out;
+    int i;
+
+    in = malloc(BUFFER_SIZE);
+    out = malloc(BUFFER_SIZE);
+
+    if (compress_lumps) {
+        spill_files[thread] = tmpfile();
     }
 
-    num_lumps++;
+    while ((i = claim_lump()) < num_lumps) {
+        if (lumps[i].file) {
+            scan_lump(&lumps[i], spill_files[thread], in, out);
+        }
+    }
+
+    free(in);
+    free(out);
 }
 
-int main(int argc, char *argv[])
+#ifdef _WIN32
+static DWORD WINAPI scan_thread(LPVOID arg)
 {
-    int filepos;
-    int tableofs;
-    lump_t *plump;
+    scan_lumps((int) (intptr_t) arg);
+    return 0;
+}
+#else
+static void *scan_thread(void *arg)
+{
+    scan_lumps((int) (intptr_t) arg);
+    return NULL;
+}
+#endif
 
-    if (argc != 3) {
-        printf("Syntax: wadtool [source directory] [destination wad]\n");
-        return EXIT_FAILURE;
+static void run_scan_threads(void)
+{
+    int i, count;
+#ifdef _WIN32
+    HANDLE threads[MAX_THREADS];
+    SYSTEM_INFO info;
+
+    if (!num_threads) {
+        GetSystemInfo(&info);
+        num_threads = info.dwNumberOfProcessors;
     }
+#else
+    pthread_t threads[MAX_THREADS];
 
-    src_dir = argv[1];
-    wad_path = argv[2];
+    if (!num_threads) {
+        num_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+#endif
 
-    if (!(wad = fopen(wad_path, "wb"))) {
-        perror("Couldn't open file for writing");
-        return EXIT_FAILURE;
+    if (num_threads < 1) {
+        num_threads = 1;
+    } else if (num_threads > MAX_THREADS) {
+        num_threads = MAX_THREADS;
     }
 
-    add_marker("S_START");
-    add_marker("S_END");
+    /* the main thread is one of the workers, and uses spill file 0 */
+    count = 0;
+    for (i = 1; i < num_threads && i < num_lumps; i++) {
+#ifdef _WIN32
+        if ((threads[count] = CreateThread(NULL, 0, scan_thread, (LPVOID) (intptr_t) (count + 1), 0, NULL))) {
+            count++;
+        }
+#else
+        if (!pthread_create(&threads[count], NULL, scan_thread, (void *) (intptr_t) (count + 1))) {
+            count++;
+        }
+#endif
+    }
 
-    add_file("PALPLAY3", "PALPLAY3.ACT");
+    scan_lumps(0);
 
-    add_marker("G_START");
-    add_file("FANCRED", "FANCRED.PNG");
-    add_file("CRSHAIRS", "CRSHAIRS.PNG");
-    add_file("BUTTONS", "BUTTONS.PNG");
-    add_file("CONFONT", "CONFONT.PNG");
-    add_file("CURSOR", "CURSOR.PNG");
-    add_marker("G_END");
+    for (i = 0; i < count; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+}
 
-    add_file("MAPINFO", "MAPINFO.TXT");
-    add_file("ANIMDEFS", "ANIMDEFS.TXT");
-    add_file("SKYDEFS", "SKYDEFS.TXT");
+/* Copies exactly size bytes from src to the WAD */
+static int copy_data(FILE *src, int size, unsigned char *buf)
+{
+    size_t n;
 
-    add_marker("ENDOFWAD");
+    while (size > 0) {
+        n = size < BUFFER_SIZE ? size : BUFFER_SIZE;
 
-    filepos = 12 + 16 * num_lumps;
-    tableofs = 12;
+        if (fread(buf, 1, n, src) != n || fwrite(buf, 1, n, wad) != n) {
+            return 0;
+        }
 
-    fwrite("PWAD", 1, 4, wad);
-    fwrite(&num_lumps, sizeof(num_lumps), 1, wad);
-    fwrite(&tableofs, sizeof(tableofs), 1, wad);
+        size -= (int) n;
+    }
 
-    plump = lumps_begin;
-    while (plump) {
-        printf("Writing lump header %.8s with offset %d\n", plump->name, filepos);
+    return 1;
+}
 
-        fwrite(&filepos, sizeof(filepos), 1, wad);
-        fwrite(&plump->size, sizeof(plump->size), 1, wad);
-        fwrite(plump->name, 1, 8, wad);
+static int same_contents(lump_t *a, lump_t *b, unsigned char *buf)
+{
+    FILE *fa, *fb;
+    unsigned char *buf_b = buf + BUFFER_SIZE;
+    size_t na, nb;
+    int same = 1;
 
-        filepos += plump->size;
-        plump = plump->next;
+    if (!strcmp(a->file, b->file)) {
+        return 1;
     }
 
-    plump = lumps_begin;
-    while (plump) {
-        FILE *f;
-        char *buf, path[512];
+    fa = fopen(a->file, "rb");
+    fb = fopen(b->file, "rb");
 
-        if (plump->size == 0) {
-            plump = plump->next;
-            continue;
+    if (!fa || !fb) {
+        same = 0;
+    }
+
+    while (same) {
+        na = fread(buf, 1, BUFFER_SIZE, fa);
+        nb = fread(buf_b, 1, BUFFER_SIZE, fb);
+
+        if (na != nb || memcmp(buf, buf_b, na)) {
+            same = 0;
+        } else if (na < BUFFER_SIZE) {
+            break;
         }
+    }
+
+    if (fa) {
+        fclose(fa);
+    }
+    if (fb) {
+        fclose(fb);
+    }
+
+    return same;
+}
+
+/* Looks for an earlier lump with byte-identical data */
+static lump_t *find_duplicate(lump_t *plump, unsigned char *buf)
+{
+    lump_t *p;
+
+    for (p = hash_table[plump->hash % HASH_SIZE]; p; p = p->hash_next) {
+        if (p->hash == plump->hash && p->size == plump->size && same_contents(p, plump, buf)) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Writes the lump's data at the current position, or points it at an
+ * identical lump that has already been written. Deflated lumps are
+ * stored behind a 4-byte length, and the high bit of the first name
+ * character is set to mark them. The directory size stays the
+ * uncompressed size.
+ */
+static int write_lump(lump_t *plump, unsigned char *buf)
+{
+    lump_t *dup;
+    FILE *f;
+    int ok;
+
+    plump->filepos = (int) ftell(wad);
+
+    if (!plump->file || plump->size == 0) {
+        return 1;
+    }
+
+    if ((dup = find_duplicate(plump, buf))) {
+        printf("Lump %.8s shares data with %c%.7s\n", plump->name, dup->name[0] & 0x7f, dup->name + 1);
+
+        plump->filepos = dup->filepos;
+        plump->name[0] |= (dup->name[0] & 0x80);
+
+        plump->packed = NULL;
+
+        return 1;
+    }
+
+    printf("Writing lump %.8s with size %d at %d\n", plump->name, plump->size, plump->filepos);
+
+    if (plump->packed) {
+        printf("Compressed lump %.8s from %d to %d bytes\n", plump->name, plump->size, plump->packed_size + 4);
+
+        plump->name[0] |= 0x80;
 
-        printf("Writing lump %.8s with size %d at %d\n", plump->name, plump->size, ftell(wad));
+        ok = fseek(plump->packed, plump->packed_pos, SEEK_SET) == 0 &&
+             fwrite(&plump->packed_size, sizeof(plump->packed_size), 1, wad) == 1 &&
+             copy_data(plump->packed, plump->packed_size, buf);
 
-        snprintf(path, 512, "%s/%s", src_dir, plump->file);
-        if (!(f = fopen(path, "rb"))) {
+        plump->packed = NULL;
+    } else {
+        if (!(f = fopen(plump->file, "rb"))) {
             perror("Couldn't open file for reading");
-            return EXIT_FAILURE;
+            return 0;
         }
-        buf = malloc(plump->size);
-        fread(buf, 1, plump->size, f);
+
+        ok = copy_data(f, plump->size, buf);
         fclose(f);
-        if (fwrite(buf, 1, plump->size, wad) != plump->size) {
+    }
+
+    plump->hash_next = hash_table[plump->hash % HASH_SIZE];
+    hash_table[plump->hash % HASH_SIZE] = plump;
+
+    return ok;
+}
+
+static void usage(void)
+{
+    printf("Syntax: wadtool [options] [manifest] [destination wad]\n");
+    printf("  -z          store lumps deflate-compressed\n");
+    printf("  -j threads  number of threads reading input files (default: one per CPU)\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int tableofs;
+    int i;
+    unsigned char *buf;
+    lump_t *plump;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-z")) {
+            compress_lumps = 1;
+        } else if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - i != 2) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    manifest_path = argv[i];
+    wad_path = argv[i + 1];
+
+    read_manifest();
+    run_scan_threads();
+
+    for (i = 0; i < num_lumps; i++) {
+        if (lumps[i].error) {
+            printf("%s: %s\n", lumps[i].file, lumps[i].error);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (!(wad = fopen(wad_path, "wb"))) {
+        perror("Couldn't open file for writing");
+        return EXIT_FAILURE;
+    }
+
+    /* the directory goes after the data, compressed sizes aren't known
+       until each lump has been written */
+    tableofs = 0;
+
+    fwrite("PWAD", 1, 4, wad);
+    fwrite(&num_lumps, sizeof(num_lumps), 1, wad);
+    fwrite(&tableofs, sizeof(tableofs), 1, wad);
+
+    buf = malloc(2 * BUFFER_SIZE);
+
+    for (i = 0; i < num_lumps; i++) {
+        if (!write_lump(&lumps[i], buf)) {
             printf("Couldn't write.\n");
             return EXIT_FAILURE;
         }
-        free(buf);
+    }
+
+    free(buf);
+
+    for (i = 0; i < MAX_THREADS; i++) {
+        if (spill_files[i]) {
+            fclose(spill_files[i]);
+        }
+    }
 
-        plump = plump->next;
+    tableofs = (int) ftell(wad);
+
+    for (i = 0; i < num_lumps; i++) {
+        plump = &lumps[i];
+
+        printf("Writing lump header %c%.7s with offset %d\n", plump->name[0] & 0x7f, plump->name + 1, plump->filepos);
+
+        fwrite(&plump->filepos, sizeof(plump->filepos), 1, wad);
+        fwrite(&plump->size, sizeof(plump->size), 1, wad);
+        fwrite(plump->name, 1, 8, wad);
+    }
+
+    fseek(wad, 8, SEEK_SET);
+    fwrite(&tableofs, sizeof(tableofs), 1, wad);
+
+    if (ferror(wad)) {
+        printf("Couldn't write.\n");
+        return EXIT_FAILURE;
     }
 
     fclose(wad);
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}